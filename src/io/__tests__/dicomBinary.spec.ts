@@ -0,0 +1,148 @@
+import { describe, it } from 'vitest';
+import { expect } from 'chai';
+import { FloatTypes, Image, ImageType, PixelTypes } from 'itk-wasm';
+import {
+  ENCODED_THUMBNAILS_BINARY_MAGIC,
+  PYRAMID_BINARY_MAGIC,
+  TAG_TABLE_BINARY_MAGIC,
+  VOLUME_MAP_BINARY_MAGIC,
+  decodeEncodedThumbnailsBinary,
+  decodePyramidBinary,
+  decodeTagTableBinary,
+  decodeVolumeMapBinary,
+} from '@src/io/dicomBinary';
+
+type Part = Uint32Array | Float64Array | Uint8Array | Float32Array;
+
+// Concatenates the bytes of parts, starting at byteOffset in the returned
+// view so unaligned outputs can be tested too.
+function concat(parts: Part[], byteOffset = 0) {
+  const length = parts.reduce((sum, part) => sum + part.byteLength, 0);
+  const bytes = new Uint8Array(byteOffset + length);
+  let offset = byteOffset;
+  parts.forEach((part) => {
+    bytes.set(
+      new Uint8Array(part.buffer, part.byteOffset, part.byteLength),
+      offset
+    );
+    offset += part.byteLength;
+  });
+  return bytes.subarray(byteOffset);
+}
+
+const words = (...values: number[]) => new Uint32Array(values);
+const text = (value: string) => new TextEncoder().encode(value);
+const decodeText = (bytes: Uint8Array) => new TextDecoder().decode(bytes);
+
+describe('dicom pipeline binary outputs', () => {
+  it('should decode the volume map', () => {
+    // volumes "a" => files [2, 0], "bc" => files [1]
+    const data = concat([
+      words(VOLUME_MAP_BINARY_MAGIC, 2, 3),
+      words(0, 2, 3),
+      words(0, 1, 3),
+      words(2, 0, 1),
+      text('abc'),
+    ]);
+    const volumes = decodeVolumeMapBinary(data);
+    expect(Object.keys(volumes)).to.deep.equal(['a', 'bc']);
+    expect(Array.from(volumes.a)).to.deep.equal([2, 0]);
+    expect(Array.from(volumes.bc)).to.deep.equal([1]);
+
+    const unaligned = concat(
+      [
+        words(VOLUME_MAP_BINARY_MAGIC, 1, 1),
+        words(0, 1),
+        words(0, 1),
+        words(7),
+        text('v'),
+      ],
+      2
+    );
+    expect(Array.from(decodeVolumeMapBinary(unaligned).v)).to.deep.equal([7]);
+  });
+
+  it('should decode encoded thumbnails', () => {
+    const data = concat([
+      words(ENCODED_THUMBNAILS_BINARY_MAGIC, 3),
+      words(3, 0, 2),
+      new Uint8Array([1, 2, 3, 4, 5]),
+    ]);
+    const [first, missing, last] = decodeEncodedThumbnailsBinary(
+      data,
+      'image/png'
+    );
+    expect(first?.size).to.equal(3);
+    expect(first?.type).to.equal('image/png');
+    expect(missing).to.equal(null);
+    expect(last?.size).to.equal(2);
+  });
+
+  it('should decode the tag table', () => {
+    // 2 files x 2 tags
+    const data = concat([
+      words(TAG_TABLE_BINARY_MAGIC, 2, 2),
+      words(0, 2, 2, 5, 6),
+      text('CTMR1x'),
+    ]);
+    const table = decodeTagTableBinary(data);
+    expect(table.map((row) => row.map(decodeText))).to.deep.equal([
+      ['CT', ''],
+      ['MR1', 'x'],
+    ]);
+  });
+
+  it('should decode pyramid levels', () => {
+    const fullResolution = new Image(
+      new ImageType(3, FloatTypes.Float32, PixelTypes.Scalar, 1)
+    );
+    fullResolution.size = [4, 2, 2];
+    fullResolution.direction = new Float64Array([0, 1, 0, 1, 0, 0, 0, 0, -1]);
+    fullResolution.data = new Float32Array(16);
+
+    const data = concat([
+      words(PYRAMID_BINARY_MAGIC, 2),
+      words(2, 1, 1, 0),
+      new Float64Array([2, 2, 2, 0.5, 0.5, -0.5]),
+      new Float32Array([1.5, 2.5]),
+      words(1, 1, 1, 0),
+      new Float64Array([4, 4, 4, 1.5, 0.5, -0.5]),
+      // one pixel, padded to 8 bytes
+      new Float32Array([3.5, 0]),
+    ]);
+    const [half, quarter] = decodePyramidBinary(data, fullResolution);
+    expect(half.size).to.deep.equal([2, 1, 1]);
+    expect(half.spacing).to.deep.equal([2, 2, 2]);
+    expect(half.origin).to.deep.equal([0.5, 0.5, -0.5]);
+    expect(Array.from(half.direction)).to.deep.equal(
+      Array.from(fullResolution.direction)
+    );
+    expect(half.data).to.be.instanceOf(Float32Array);
+    expect(Array.from(half.data as Float32Array)).to.deep.equal([1.5, 2.5]);
+    expect(quarter.size).to.deep.equal([1, 1, 1]);
+    expect(quarter.spacing).to.deep.equal([4, 4, 4]);
+    expect(Array.from(quarter.data as Float32Array)).to.deep.equal([3.5]);
+  });
+
+  it('should reject outputs with the wrong magic', () => {
+    const wrong = concat([words(0x30303030, 0, 0, 0, 0, 0, 0)]);
+    expect(() => decodeVolumeMapBinary(wrong)).to.throw(
+      'Invalid binary volume map'
+    );
+    expect(() => decodeEncodedThumbnailsBinary(wrong, 'image/png')).to.throw(
+      'Invalid binary encoded thumbnails'
+    );
+    expect(() => decodeTagTableBinary(wrong)).to.throw(
+      'Invalid binary tag table'
+    );
+    expect(() => decodePyramidBinary(wrong, new Image())).to.throw(
+      'Invalid binary pyramid'
+    );
+
+    // formats are told apart by their magic, which also carries the version
+    const tagTable = concat([words(TAG_TABLE_BINARY_MAGIC, 0, 0, 0)]);
+    expect(() => decodeEncodedThumbnailsBinary(tagTable, 'image/png')).to.throw(
+      'Invalid binary encoded thumbnails'
+    );
+  });
+});
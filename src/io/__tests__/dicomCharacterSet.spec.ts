@@ -0,0 +1,111 @@
+import { describe, it } from 'vitest';
+import { expect } from 'chai';
+import { decodeDicomString } from '@src/io/dicomCharacterSet';
+
+const ESC = 0x1b;
+
+// Concatenates ASCII strings and raw bytes
+function bytes(...parts: Array<string | number[]>) {
+  return new Uint8Array(
+    parts.flatMap((part) =>
+      typeof part === 'string'
+        ? Array.from(part, (c) => c.charCodeAt(0))
+        : part
+    )
+  );
+}
+
+describe('decodeDicomString', () => {
+  it('should decode single byte character sets', () => {
+    expect(decodeDicomString(bytes('Doe^John'), '')).to.equal('Doe^John');
+    expect(
+      decodeDicomString(bytes('Buc^J', [0xe9], 'r', [0xf4], 'me'), 'ISO_IR 100')
+    ).to.equal('Buc^Jérôme');
+    expect(
+      decodeDicomString(bytes([0xe3, 0x81, 0x82]), 'ISO_IR 192')
+    ).to.equal('あ');
+  });
+
+  // PS3.5 H.3.2
+  it('should switch to JIS X 0208 on escape sequences', () => {
+    const value = bytes(
+      'Yamada^Tarou=',
+      [ESC],
+      '$B;3ED',
+      [ESC],
+      '(B^',
+      [ESC],
+      '$BB@O:',
+      [ESC],
+      '(B=',
+      [ESC],
+      '$B$d$^$@',
+      [ESC],
+      '(B^',
+      [ESC],
+      '$B$?$m$&',
+      [ESC],
+      '(B'
+    );
+    expect(decodeDicomString(value, '\\ISO 2022 IR 87')).to.equal(
+      'Yamada^Tarou=山田^太郎=やまだ^たろう'
+    );
+  });
+
+  // PS3.5 H.3.1
+  it('should decode KS X 1001 invoked in G1', () => {
+    const value = bytes(
+      'Hong^Gildong=',
+      [ESC],
+      '$)C',
+      [0xfb, 0xf3],
+      '^',
+      [ESC],
+      '$)C',
+      [0xd1, 0xce, 0xd4, 0xd7],
+      '=',
+      [ESC],
+      '$)C',
+      [0xc8, 0xab],
+      '^',
+      [ESC],
+      '$)C',
+      [0xb1, 0xe6, 0xb5, 0xbf]
+    );
+    expect(decodeDicomString(value, '\\ISO 2022 IR 149')).to.equal(
+      'Hong^Gildong=洪^吉洞=홍^길동'
+    );
+  });
+
+  // PS3.5 I.2, with half-width katakana before any escape sequence
+  it('should start in the character set of the first term', () => {
+    const value = bytes(
+      [0xd4, 0xcf, 0xc0, 0xde],
+      '^',
+      [0xc0, 0xdb, 0xb3],
+      '=',
+      [ESC],
+      '$B;3ED',
+      [ESC],
+      '(J^',
+      [ESC],
+      '$BB@O:',
+      [ESC],
+      '(J'
+    );
+    expect(
+      decodeDicomString(value, 'ISO 2022 IR 13\\ISO 2022 IR 87')
+    ).to.equal('ﾔﾏﾀﾞ^ﾀﾛｳ=山田^太郎');
+  });
+
+  it('should decode JIS X 0212', () => {
+    const value = bytes([ESC], '$(D0!0"', [ESC], '(B');
+    expect(
+      decodeDicomString(value, '\\ISO 2022 IR 87\\ISO 2022 IR 159')
+    ).to.equal('丂丄');
+  });
+
+  it('should drop unknown escape sequences', () => {
+    expect(decodeDicomString(bytes('a', [ESC], 'b'), '')).to.equal('ab');
+  });
+});
@@ -1,20 +1,38 @@
-import { runPipeline, TextStream, InterfaceTypes, Image } from 'itk-wasm';
+import {
+  runPipeline,
+  BinaryStream,
+  TextStream,
+  InterfaceTypes,
+  Image,
+  imageSharedBufferOrCopy,
+} from 'itk-wasm';
 
 import {
-  readDicomTags,
   readImageDicomFileSeries,
   setPipelinesBaseUrl,
   setPipelineWorkerUrl,
 } from '@itk-wasm/dicom';
 
 import itkConfig from '@/src/io/itk/itkConfig';
+import {
+  ThumbnailEncoding,
+  decodeEncodedThumbnailsBinary,
+  decodePyramidBinary,
+  decodeTagTableBinary,
+  decodeVolumeMapBinary,
+} from './dicomBinary';
+import { decodeDicomString } from './dicomCharacterSet';
 // import { record } from 'zod';
 
 export interface TagSpec {
   name: string;
   tag: string;
+  // decode the value from the file's Specific Character Set
+  strconv?: boolean;
 }
 
+export type { ThumbnailEncoding };
+
 export type SpatialParameters = Pick<
   Image,
   'size' | 'spacing' | 'origin' | 'direction'
@@ -26,6 +44,126 @@ export type VolumesToFileNamesMap = Record<string, string[]>;
 // volume ID => files
 export type VolumesToFilesMap = Record<string, File[]>;
 
+// volume ID => indexes of the files in the categorize input
+export type VolumesToFileIndexesMap = Record<string, ArrayLike<number>>;
+
+// Problems found in the slice positions of a categorized volume
+export interface SliceDiagnostics {
+  duplicatePositions: number;
+  missingSlices: number;
+  // median, smallest and largest distance between distinct positions
+  nominalSpacing: number;
+  minSpacing: number;
+  maxSpacing: number;
+  irregularSpacing: boolean;
+}
+
+// Slice layout of a categorized volume, whose files are listed in order, and
+// the geometry of the image buildImage will return for it
+export interface VolumeGeometry {
+  // files are ordered on their position along the slice normal
+  sortedByPosition: boolean;
+  // mean distance between slices, 0 if not sorted by position
+  sliceSpacing: number;
+  diagnostics: SliceDiagnostics;
+  size: number[];
+  spacing: number[];
+  origin: number[];
+  // row-major, with the row, column and slice directions as columns
+  direction: number[];
+}
+
+export interface CategorizedVolumes {
+  volumes: VolumesToFilesMap;
+  // volume ID => geometry, missing for the volumes split from multi-frame
+  // files
+  geometry: Record<string, VolumeGeometry>;
+}
+
+// Rescale Slope and Intercept of a slice, which GDCM has already applied to
+// its pixels: they hold slope * stored value + intercept
+export interface SliceRescale {
+  slope: number;
+  intercept: number;
+}
+
+export interface VolumeSlice {
+  image: Image;
+  // null for thumbnails and single frames, which are not native slices
+  rescale: SliceRescale | null;
+}
+
+// Counters of the slice cache kept in the dicom worker
+export interface SliceCacheStats {
+  // whether the last slice came from the cache
+  hit: boolean;
+  hits: number;
+  misses: number;
+  entries: number;
+  bytes: number;
+  budget: number;
+}
+
+const SPECIFIC_CHARACTER_SET_TAG = '0008|0005';
+
+// Exit status of getSliceImage for a slice no longer cached by the worker.
+const SLICE_CACHE_MISS_EXIT_CODE = 2;
+
+// Series with fewer slices are built without previews.
+const PREVIEW_MIN_SLICES = 256;
+// Slices read for the first preview, at most.
+const PREVIEW_MAX_SLICES = 128;
+
+/**
+ * Returns the coarse passes built before the full volume, as [slice step,
+ * in-plane shrink] pairs from coarsest to finest.
+ * @param sliceCount
+ * @returns
+ */
+function previewPasses(sliceCount: number): Array<[number, number]> {
+  if (sliceCount < PREVIEW_MIN_SLICES) {
+    return [];
+  }
+  const step = 2 ** Math.ceil(Math.log2(sliceCount / PREVIEW_MAX_SLICES));
+  const passes: Array<[number, number]> = [[step, 4]];
+  if (step >= 8) {
+    passes.push([step / 4, 2]);
+  }
+  return passes;
+}
+
+// Bounds on the file contents sent to the worker in one batch.
+const BATCH_MAX_BYTES = 256 * 1024 * 1024;
+const BATCH_MAX_FILES = 500;
+
+/**
+ * Splits files into consecutive [start, end) ranges, each bounded in total
+ * size and number of files.
+ * @param files
+ * @returns
+ */
+function batchFiles(files: File[]) {
+  const batches: Array<[number, number]> = [];
+  let start = 0;
+  let bytes = 0;
+  files.forEach((file, index) => {
+    if (
+      index > start &&
+      (bytes + file.size > BATCH_MAX_BYTES ||
+        index - start >= BATCH_MAX_FILES)
+    ) {
+      batches.push([start, index]);
+      start = index;
+      bytes = 0;
+    }
+    bytes += file.size;
+  });
+  if (start < files.length) {
+    batches.push([start, files.length]);
+  }
+  return batches;
+}
+
 /**
  * Filenames must be sanitized prior to being passed into itk-wasm.
  *
@@ -48,10 +186,22 @@ function sanitizeFile(file: File) {
 export class DICOMIO {
   private webWorker: any;
   private initializeCheck: Promise<void> | null;
+  private categorizeSessions: number;
+  // file => identity of the file in the worker slice cache
+  private sliceCacheKeys: WeakMap<File, string>;
+  private nextSliceCacheKey: number;
+  // slices the worker was given the file of, by cache key and read options
+  private cachedSlices: Set<string>;
+  public sliceCacheStats: SliceCacheStats | null;
 
   constructor() {
     this.webWorker = null;
     this.initializeCheck = null;
+    this.categorizeSessions = 0;
+    this.sliceCacheKeys = new WeakMap();
+    this.nextSliceCacheKey = 0;
+    this.cachedSlices = new Set();
+    this.sliceCacheStats = null;
   }
 
   private async runTask(
@@ -85,15 +235,7 @@ export class DICOMIO {
               reject(new Error('Could not initialize webworker'));
             }
           })
-          .then(async () => {
-            // preload read-dicom-tags pipeline
-            try {
-              await readDicomTags(this.webWorker, new File([], ''));
-            } catch {
-              // ignore
-            }
-            resolve();
-          })
+          .then(() => resolve())
           .catch(reject);
       });
     }
@@ -102,21 +244,29 @@ export class DICOMIO {
   }
 
   /**
-   * Categorize files
+   * Adds a batch of files to a categorize session.
    * @async
+   * @param {string} session
    * @param {File[]} files
-   * @returns volumeID => file names mapping
+   * @param {number} firstIndex index of the first file in the session
+   * @param {Boolean} finish end the session
+   * @returns volumeID => indexes of the files contributed by the batch, or of
+   * every file when finishing, and the volume geometry when finishing
    */
-  async categorizeFiles(files: File[]): Promise<VolumesToFilesMap> {
-    await this.initialize();
-
+  private async categorizeBatch(
+    session: string,
+    files: File[],
+    firstIndex: number,
+    finish = false
+  ) {
     const inputs = await Promise.all(
-      files.map(async (file, index) => {
+      files.map(async (file, offset) => {
         const buffer = await file.arrayBuffer();
         return {
           type: InterfaceTypes.BinaryFile,
           data: {
-            path: index.toString(), // make each file name unique
+            // make each file name unique within the session
+            path: (firstIndex + offset).toString(),
             data: new Uint8Array(buffer),
           },
         };
@@ -125,56 +275,178 @@ export class DICOMIO {
 
     const args = [
       '--action',
-      'categorize',
+      'categorizeBatch',
       '--memory-io',
       '0',
-      '--files',
-      ...inputs.map((fd) => fd.data.path),
+      '--volume-map-binary',
+      '1',
+      '--session',
+      session,
+      ...(finish ? ['--finish', '--volume-geometry', '2'] : []),
+      ...(inputs.length
+        ? ['--files', ...inputs.map((fd) => fd.data.path)]
+        : []),
     ];
 
-    const outputs = [{ type: InterfaceTypes.TextStream }];
+    // The JSON stream is left empty when the binary map is requested
+    const outputs = [
+      { type: InterfaceTypes.TextStream },
+      { type: InterfaceTypes.BinaryStream },
+      ...(finish ? [{ type: InterfaceTypes.TextStream }] : []),
+    ];
 
     const result = await this.runTask('dicom', args, inputs, outputs);
 
-    // File names are indexes into input files array
-    const volumeToFileIndexes = JSON.parse(
-      (result.outputs[0].data as TextStream).data
-    ) as VolumesToFileNamesMap;
+    return {
+      // File indexes are positions in the session's files
+      volumes: decodeVolumeMapBinary(
+        (result.outputs[1].data as BinaryStream).data
+      ),
+      geometry: finish
+        ? (JSON.parse((result.outputs[2].data as TextStream).data) as Record<
+            string,
+            VolumeGeometry
+          >)
+        : {},
+    };
+  }
+
+  /**
+   * Categorize files
+   *
+   * Files are sent to the worker in bounded batches, so only one batch is
+   * held in memory at a time.
+   * @async
+   * @param {File[]} files
+   * @param onBatch called after each batch with volumeID => the files of the
+   * batch added to that volume, in input order. Volumes split from
+   * multi-frame files are only told apart in the returned mapping.
+   * @returns volumeID => files mapping, with the files of each volume in slice
+   * order, and the geometry found while ordering them
+   */
+  async categorizeFiles(
+    files: File[],
+    onBatch?: (volumes: VolumesToFilesMap) => void
+  ): Promise<CategorizedVolumes> {
+    await this.initialize();
+
+    const indexesToFiles = (volumeToIndexes: VolumesToFileIndexesMap) =>
+      Object.fromEntries(
+        Object.entries(volumeToIndexes).map(([volumeKey, fileIndexes]) => [
+          volumeKey,
+          Array.from(fileIndexes, (fileIndex) => files[fileIndex]),
+        ])
+      );
+
+    this.categorizeSessions += 1;
+    const session = this.categorizeSessions.toString();
+
+    const batches = batchFiles(files);
+    for (let i = 0; i < batches.length; i++) {
+      const [start, end] = batches[i];
+      const { volumes: batchVolumes } = await this.categorizeBatch(
+        session,
+        files.slice(start, end),
+        start
+      );
+      onBatch?.(indexesToFiles(batchVolumes));
+    }
+
+    const { volumes: volumeToFileIndexes, geometry } =
+      await this.categorizeBatch(session, [], 0, true);
 
     // Check NumberOfFrame
-    const vtfi:VolumesToFileNamesMap = {};
-
-    // const promises = 
-    await Promise.all(Object.entries(volumeToFileIndexes).map(async ([vkey, fileIndexes]) => {
-      // console.log(`vkey:${vkey}`);
-      const nofTag = await this.readTags(sanitizeFile(files[parseInt(fileIndexes[0], 10)]),
-        [{ name: 'NumberOfFrame', tag: '0028|0008', strconv: true }]);
-      if (nofTag.NumberOfFrame.length > 0) {
-        // console.log(`NumberOfFrame:${nofTag.NumberOfFrame}`);
-        
-        if (fileIndexes.length > 0) {
-          fileIndexes.forEach(idx => {
-            vtfi[vkey + idx] = [idx];
-          })
-        }
+    const volumeKeys = Object.keys(volumeToFileIndexes);
+    const volumeTags = await this.readTagsOfFiles(
+      volumeKeys.map((vkey) => files[volumeToFileIndexes[vkey][0]]),
+      [{ name: 'NumberOfFrame', tag: '0028|0008' }]
+    );
+
+    const vtfi: Record<string, number[]> = {};
+    volumeKeys.forEach((vkey, v) => {
+      const fileIndexes = Array.from(volumeToFileIndexes[vkey]);
+      if (volumeTags[v].NumberOfFrame.length > 0) {
+        fileIndexes.forEach((idx) => {
+          vtfi[vkey + idx] = [idx];
+        });
       } else {
         vtfi[vkey] = fileIndexes;
       }
-    }));
-
-    // for (const p of promises) {
-    //   await p;
-    // }
-
-    const volumeToFiles = Object.fromEntries(
-      Object.entries(vtfi).map(([volumeKey, fileIndexes]) => [
-        volumeKey,
-        // file indexes to Files
-        fileIndexes.map((fileIndex) => files[parseInt(fileIndex, 10)]),
-      ])
-    );
+    });
+
+    return { volumes: indexesToFiles(vtfi), geometry };
+  }
+
+  /**
+   * Reads a list of tags out from many files, with one pipeline call per
+   * bounded batch of files. Only the file headers are parsed.
+   * @async
+   * @param {File[]} files
+   * @param {[]Tag} tags
+   * @returns name => value of the tags of each file, '' for missing tags
+   */
+  async readTagsOfFiles<T extends TagSpec[]>(
+    files: File[],
+    tags: T
+  ): Promise<Array<Record<T[number]['name'], string>>> {
+    await this.initialize();
 
-    return volumeToFiles;
+    // read along to decode the strconv tags
+    const tagArgs = [...tags.map(({ tag }) => tag), SPECIFIC_CHARACTER_SET_TAG];
+    const asciiDecoder = new TextDecoder();
+
+    const fileTags: Array<Record<T[number]['name'], string>> = [];
+    const batches = batchFiles(files);
+    for (let i = 0; i < batches.length; i++) {
+      const [start, end] = batches[i];
+      const inputs = await Promise.all(
+        files.slice(start, end).map(async (file, offset) => {
+          const buffer = await file.arrayBuffer();
+          return {
+            type: InterfaceTypes.BinaryFile,
+            data: {
+              // files of different series may share a name
+              path: offset.toString(),
+              data: new Uint8Array(buffer),
+            },
+          };
+        })
+      );
+
+      const args = [
+        '--action',
+        'readTags',
+        '--files',
+        ...inputs.map((fd) => fd.data.path),
+        '--tags',
+        ...tagArgs,
+        '--memory-io',
+        '0',
+      ];
+
+      const outputs = [{ type: InterfaceTypes.BinaryStream }];
+
+      const result = await this.runTask('dicom', args, inputs, outputs);
+
+      const table = decodeTagTableBinary(
+        (result.outputs[0].data as BinaryStream).data
+      );
+      table.forEach((values) => {
+        const specificCharacterSet = asciiDecoder.decode(values[tags.length]);
+        fileTags.push(
+          tags.reduce(
+            (info, { name, strconv }, t) => ({
+              ...info,
+              [name]: strconv
+                ? decodeDicomString(values[t], specificCharacterSet)
+                : asciiDecoder.decode(values[t]),
+            }),
+            {} as Record<T[number]['name'], string>
+          )
+        );
+      });
+    }
+    return fileTags;
   }
 
   /**
@@ -187,34 +459,100 @@ export class DICOMIO {
     file: File,
     tags: T
   ): Promise<Record<T[number]['name'], string>> {
-    const tagsArgs = { tagsToRead: { tags: tags.map(({ tag }) => tag) } };
-
-    const result = await readDicomTags(
-      this.webWorker,
-      sanitizeFile(file),
-      tagsArgs
-    );
-    const tagValues = new Map(result.tags);
-
-    return tags.reduce((info, t) => {
-      const { tag, name } = t;
-      if (tagValues.has(tag)) {
-        return { ...info, [name]: tagValues.get(tag) };
-      }
-      return info;
-    }, {} as Record<T[number]['name'], string>);
+    const [tagValues] = await this.readTagsOfFiles([file], tags);
+    return tagValues;
   }
 
   /**
    * Retrieves a slice of a volume.
+   *
+   * The worker keeps decoded slices in a cache, so a slice retrieved again is
+   * usually answered without sending or decoding its file.
    * @async
    * @param {File} file containing the slice
    * @param {Boolean} asThumbnail cast image to unsigned char. Defaults to false.
-   * @returns ItkImage
+   * @param {Number} thumbnailSize longest thumbnail edge the slice is shrunk
+   * to, 0 to keep its full resolution. Defaults to 0.
+   * @param {Number} frame only decode this frame of a multi-frame file, -1 to
+   * decode all of them. Defaults to -1.
+   * @returns the slice, in its native pixel type unless it is a thumbnail or
+   * a single frame, with the rescale applied to native slices
    */
-  async getVolumeSlice(file: File, asThumbnail: boolean = false) {
+  async getVolumeSlice(
+    file: File,
+    asThumbnail: boolean = false,
+    thumbnailSize: number = 0,
+    frame: number = -1
+  ): Promise<VolumeSlice> {
     await this.initialize();
 
+    if (!this.sliceCacheKeys.has(file)) {
+      this.sliceCacheKeys.set(file, String(this.nextSliceCacheKey++));
+    }
+    const cacheKey = this.sliceCacheKeys.get(file)!;
+    const sliceKey = [cacheKey, asThumbnail, thumbnailSize, frame].join('|');
+
+    const args = [
+      '--action',
+      'getSliceImage',
+      '--thumbnail',
+      asThumbnail.toString(),
+      '--thumbnail-size',
+      thumbnailSize.toString(),
+      '--frame',
+      frame.toString(),
+      '--cache-key',
+      cacheKey,
+      '--memory-io',
+      '0',
+      '--cache-stats',
+      '1',
+    ];
+
+    const outputs = [
+      { type: InterfaceTypes.Image },
+      { type: InterfaceTypes.TextStream },
+    ];
+
+    // only native slices have their pixel types and rescale reported
+    const isNativeSlice = !asThumbnail && frame < 0;
+    if (isNativeSlice) {
+      args.push('--slice-info', '2');
+      outputs.push({ type: InterfaceTypes.TextStream });
+    }
+
+    const readResult = (result: any): VolumeSlice => {
+      this.sliceCacheStats = JSON.parse(
+        (result.outputs[1].data as TextStream).data
+      );
+      let rescale: SliceRescale | null = null;
+      if (isNativeSlice) {
+        const sliceInfo = JSON.parse(
+          (result.outputs[2].data as TextStream).data
+        );
+        rescale = {
+          slope: sliceInfo.rescaleSlope,
+          intercept: sliceInfo.rescaleIntercept,
+        };
+      }
+      return { image: result.outputs[0].data as Image, rescale };
+    };
+
+    // The worker may have evicted the slice since, in which case the file is
+    // sent after all.
+    if (this.cachedSlices.has(sliceKey)) {
+      const result = await this.runTask('dicom', args, [], outputs);
+      this.cachedSlices.delete(sliceKey);
+      if (result.returnValue === 0) {
+        // most recently used last, like the worker's cache
+        this.cachedSlices.add(sliceKey);
+        return readResult(result);
+      }
+      if (result.returnValue !== SLICE_CACHE_MISS_EXIT_CODE) {
+        throw new Error(`Could not read the slice: ${result.stderr}`);
+      }
+    }
+
     const buffer = await file.arrayBuffer();
 
     const inputs = [
@@ -227,24 +565,115 @@ export class DICOMIO {
       },
     ];
 
-    const args = [
-      '--action',
-      'getSliceImage',
-      '--thumbnail',
-      asThumbnail.toString(),
-      '--file',
-      sanitizeFileName(file.name),
-      '--memory-io',
-      '0',
-    ];
+    const result = await this.runTask(
+      'dicom',
+      [...args, '--file', sanitizeFileName(file.name)],
+      inputs,
+      outputs
+    );
+    if (result.returnValue !== 0) {
+      throw new Error(`Could not read the slice: ${result.stderr}`);
+    }
+    const slice = readResult(result);
 
-    const outputs = [{ type: InterfaceTypes.Image }];
+    this.cachedSlices.add(sliceKey);
+    this.trimCachedSlices();
+    return slice;
+  }
 
-    const result = await this.runTask('dicom', args, inputs, outputs);
+  /**
+   * Forgets the least recently used slices past the number the worker's cache
+   * holds, which it has evicted under its --cache-budget.
+   */
+  private trimCachedSlices() {
+    const entries = this.sliceCacheStats?.entries ?? 0;
+    const excess = this.cachedSlices.size - entries;
+    if (excess > 0) {
+      // Sets iterate in insertion order, so the oldest keys come first
+      Array.from(this.cachedSlices)
+        .slice(0, excess)
+        .forEach((key) => this.cachedSlices.delete(key));
+    }
+  }
 
-    return result.outputs[0].data as Image;
+  /**
+   * Retrieves the thumbnails of many slices as PNG or JPEG files, which can be
+   * shown as they are, with one pipeline call per bounded batch of files.
+   * @async
+   * @param {File[]} files each containing a slice
+   * @param {Number} thumbnailSize longest thumbnail edge the slices are shrunk
+   * to, 0 to keep their full resolution
+   * @param {Number[]} frames the frame to decode for each file, -1 for the
+   * first frame of the whole decoded file. Defaults to -1 for every file.
+   * @param {ThumbnailEncoding} encoding Defaults to PNG.
+   * @returns one encoded image per file, or null if it could not be read
+   */
+  async getEncodedThumbnails(
+    files: File[],
+    thumbnailSize: number,
+    frames: number[] = [],
+    encoding: ThumbnailEncoding = 'png'
+  ) {
+    await this.initialize();
+
+    const thumbnails: Array<Blob | null> = [];
+    const batches = batchFiles(files);
+    for (let i = 0; i < batches.length; i++) {
+      const [start, end] = batches[i];
+      const inputs = await Promise.all(
+        files.slice(start, end).map(async (file, offset) => {
+          const buffer = await file.arrayBuffer();
+          return {
+            type: InterfaceTypes.BinaryFile,
+            data: {
+              // files of different series may share a name
+              path: offset.toString(),
+              data: new Uint8Array(buffer),
+            },
+          };
+        })
+      );
+
+      const args = [
+        '--action',
+        'getThumbnails',
+        '--thumbnail-size',
+        thumbnailSize.toString(),
+        '--files',
+        ...inputs.map((fd) => fd.data.path),
+        ...(frames.length
+          ? ['--frames', ...frames.slice(start, end).map(String)]
+          : []),
+        '--encoding',
+        encoding,
+        '--memory-io',
+        '0',
+      ];
+
+      const outputs = [{ type: InterfaceTypes.BinaryStream }];
+
+      const result = await this.runTask('dicom', args, inputs, outputs);
+
+      thumbnails.push(
+        ...decodeEncodedThumbnailsBinary(
+          (result.outputs[0].data as BinaryStream).data,
+          `image/${encoding}`
+        )
+      );
+    }
+    return thumbnails;
   }
 
+  /**
+   * Resamples a 3D image onto the grid of fixed, with linear interpolation.
+   *
+   * Runs in the dicom worker, so volumes built there are not sent to the
+   * separate resample module and its worker pool.
+   * @async
+   * @param {SpatialParameters} fixed the output grid
+   * @param {Image} moving
+   * @returns ItkImage
+   */
   async resample(fixed: SpatialParameters, moving: Image) {
     await this.initialize();
 
@@ -275,19 +704,142 @@ export class DICOMIO {
     return image;
   }
 
+  /**
+   * Builds a power-of-two pyramid of a 3D image, for showing a coarse level
+   * while interacting and the full level when idle.
+   *
+   * Every level is half the size of the one before along each axis, down to
+   * a single voxel, and is shrunk from that level rather than from the full
+   * resolution image.
+   * @async
+   * @param {Image} image the full resolution level
+   * @param {Number} levels most levels to return, with the full resolution
+   * one, or 0 for all of them
+   * @returns the levels, finest first, starting with image itself
+   */
+  async buildPyramid(image: Image, levels = 0) {
+    await this.initialize();
+
+    const args = [
+      '--action',
+      'buildPyramid',
+      '0', // space for input image
+
+      '--levels',
+      levels.toString(),
+
+      '--memory-io',
+      '0',
+    ];
+
+    // the input is transferred to the worker, so image keeps its pixels
+    const inputs = [
+      { type: InterfaceTypes.Image, data: imageSharedBufferOrCopy(image) },
+    ];
+    const outputs = [{ type: InterfaceTypes.BinaryStream }];
+
+    const result = await this.runTask('dicom', args, inputs, outputs);
+    return [
+      image,
+      ...decodePyramidBinary(
+        (result.outputs[0].data as BinaryStream).data,
+        image
+      ),
+    ];
+  }
+
+  /**
+   * Builds a coarse volume out of every sliceStep-th file, shrunk in-plane.
+   * @async
+   * @param {File[]} seriesFiles in slice order
+   * @param {Number} sliceStep
+   * @param {Number} shrink in-plane shrink factor
+   * @returns ItkImage, with the component type of the full volume
+   */
+  private async buildPreviewImage(
+    seriesFiles: File[],
+    sliceStep: number,
+    shrink: number
+  ) {
+    const files = seriesFiles.filter((_, index) => index % sliceStep === 0);
+    const inputs = await Promise.all(
+      files.map(async (file, offset) => {
+        const buffer = await file.arrayBuffer();
+        return {
+          type: InterfaceTypes.BinaryFile,
+          data: {
+            path: offset.toString(),
+            data: new Uint8Array(buffer),
+          },
+        };
+      })
+    );
+
+    const args = [
+      '--action',
+      'buildVolumePreview',
+      '--shrink',
+      shrink.toString(),
+      '--files',
+      ...inputs.map((fd) => fd.data.path),
+      '--memory-io',
+      '0',
+    ];
+
+    const outputs = [{ type: InterfaceTypes.Image }];
+
+    const result = await this.runTask('dicom', args, inputs, outputs);
+    return result.outputs[0].data as Image;
+  }
+
+  /**
+   * Builds a volume for a set of files, handing coarser volumes to onPreview
+   * first for large series.
+   *
+   * The first preview only reads a few evenly spaced slices at a quarter of
+   * their resolution, so something can be shown long before the full volume
+   * is read. A preview that fails to build is skipped.
+   * @async
+   * @param {File[]} seriesFiles the set of files to build volume from, in the
+   * slice order returned by categorizeFiles
+   * @param onPreview
+   * @returns the full ItkImage
+   */
+  async buildImageProgressive(
+    seriesFiles: File[],
+    onPreview: (image: Image) => void
+  ) {
+    await this.initialize();
+
+    const passes = previewPasses(seriesFiles.length);
+    for (let i = 0; i < passes.length; i++) {
+      const [sliceStep, shrink] = passes[i];
+      try {
+        onPreview(await this.buildPreviewImage(seriesFiles, sliceStep, shrink));
+      } catch (err) {
+        // the next pass, or the full volume, is shown instead
+      }
+    }
+
+    return this.buildImage(seriesFiles);
+  }
+
   /**
    * Builds a volume for a set of files.
    * @async
-   * @param {File[]} seriesFiles the set of files to build volume from
+   * @param {File[]} seriesFiles the set of files to build volume from, in the
+   * slice order returned by categorizeFiles
    * @returns ItkImage
    */
   async buildImage(seriesFiles: File[]) {
     await this.initialize();
 
     const inputImages = seriesFiles.map((file) => sanitizeFile(file));
+    // categorizeFiles already sorted the files, so skip the second header
+    // parse needed to sort them again
     const result = await readImageDicomFileSeries(null, {
       inputImages,
-      singleSortedSeries: false,
+      singleSortedSeries: true,
     });
 
     return result.outputImage;
@@ -0,0 +1,171 @@
+import { Image, TypedArray } from 'itk-wasm';
+import type { VolumesToFileIndexesMap } from './dicom';
+
+// Decoders of the binary outputs of the dicom pipeline. Each layout is
+// documented with the action writing it in itk-dicom/dicom.cpp. Fields are
+// in host order, which is little-endian for WebAssembly.
+
+// 'VVM1' read as a little-endian uint32
+export const VOLUME_MAP_BINARY_MAGIC = 0x314d5656;
+
+// Uint32Array views need a 4-byte aligned offset
+function alignWords(data: Uint8Array) {
+  return data.byteOffset % 4 === 0 ? data : data.slice();
+}
+
+/**
+ * Decodes the volume map written to the dicom pipeline's --volume-map-binary
+ * output. The file indexes are views into the given buffer.
+ * @param data
+ * @returns
+ */
+
+export function decodeVolumeMapBinary(
+  data: Uint8Array
+): VolumesToFileIndexesMap {
+  const bytes = alignWords(data);
+  const words = (offset: number, length: number) =>
+    new Uint32Array(bytes.buffer, bytes.byteOffset + offset * 4, length);
+
+  const [magic, volumeCount, fileCount] = words(0, 3);
+  if (magic !== VOLUME_MAP_BINARY_MAGIC) {
+    throw new Error('Invalid binary volume map');
+  }
+  const fileOffsets = words(3, volumeCount + 1);
+  const idOffsets = words(4 + volumeCount, volumeCount + 1);
+  const fileIndexes = words(5 + 2 * volumeCount, fileCount);
+  const ids = bytes.subarray((5 + 2 * volumeCount + fileCount) * 4);
+
+  const decoder = new TextDecoder();
+  const volumes: VolumesToFileIndexesMap = {};
+  for (let v = 0; v < volumeCount; v++) {
+    const volumeID = decoder.decode(
+      ids.subarray(idOffsets[v], idOffsets[v + 1])
+    );
+    volumes[volumeID] = fileIndexes.subarray(
+      fileOffsets[v],
+      fileOffsets[v + 1]
+    );
+  }
+  return volumes;
+}
+
+// 'TAG1' read as a little-endian uint32
+export const TAG_TABLE_BINARY_MAGIC = 0x31474154;
+
+/**
+ * Decodes the tag values written by the dicom pipeline's readTags action.
+ * @param data
+ * @returns the undecoded bytes of each tag of each file, as views into the
+ * given buffer
+ */
+export function decodeTagTableBinary(data: Uint8Array) {
+  const bytes = alignWords(data);
+  const [magic, fileCount, tagCount] = new Uint32Array(
+    bytes.buffer,
+    bytes.byteOffset,
+    3
+  );
+  if (magic !== TAG_TABLE_BINARY_MAGIC) {
+    throw new Error('Invalid binary tag table');
+  }
+  const offsets = new Uint32Array(
+    bytes.buffer,
+    bytes.byteOffset + 12,
+    fileCount * tagCount + 1
+  );
+  const values = bytes.subarray((4 + fileCount * tagCount) * 4);
+
+  const table: Uint8Array[][] = [];
+  for (let f = 0; f < fileCount; f++) {
+    const row: Uint8Array[] = [];
+    for (let t = 0; t < tagCount; t++) {
+      const i = f * tagCount + t;
+      row.push(values.subarray(offsets[i], offsets[i + 1]));
+    }
+    table.push(row);
+  }
+  return table;
+}
+
+// 'VTE1' read as a little-endian uint32
+export const ENCODED_THUMBNAILS_BINARY_MAGIC = 0x31455456;
+
+export type ThumbnailEncoding = 'png' | 'jpeg';
+
+/**
+ * Decodes the thumbnails written by the dicom pipeline's getThumbnails
+ * action with --encoding.
+ * @param data
+ * @param type MIME type of the thumbnails
+ * @returns one encoded image per file, or null if it could not be read
+ */
+export function decodeEncodedThumbnailsBinary(
+  data: Uint8Array,
+  type: string
+): Array<Blob | null> {
+  const bytes = alignWords(data);
+  const [magic, count] = new Uint32Array(bytes.buffer, bytes.byteOffset, 2);
+  if (magic !== ENCODED_THUMBNAILS_BINARY_MAGIC) {
+    throw new Error('Invalid binary encoded thumbnails');
+  }
+  const lengths = new Uint32Array(bytes.buffer, bytes.byteOffset + 8, count);
+
+  let offset = (2 + count) * 4;
+  return Array.from(lengths, (length) => {
+    if (length === 0) {
+      return null;
+    }
+    const blob = new Blob([bytes.subarray(offset, offset + length)], { type });
+    offset += length;
+    return blob;
+  });
+}
+
+// 'VPY1' read as a little-endian uint32
+export const PYRAMID_BINARY_MAGIC = 0x31595056;
+
+type TypedArrayConstructor = {
+  new (buffer: ArrayBufferLike, byteOffset: number, length: number): TypedArray;
+};
+
+/**
+ * Decodes the levels written by the dicom pipeline's buildPyramid action.
+ * The pixels of each level are views into the given buffer.
+ * @param data
+ * @param fullResolution the image the pyramid was built from
+ * @returns the levels below full resolution, finest first
+ */
+export function decodePyramidBinary(
+  data: Uint8Array,
+  fullResolution: Image
+) {
+  // Float64Array views need an 8-byte aligned offset
+  const bytes = data.byteOffset % 8 === 0 ? data : data.slice();
+  const [magic, count] = new Uint32Array(bytes.buffer, bytes.byteOffset, 2);
+  if (magic !== PYRAMID_BINARY_MAGIC) {
+    throw new Error('Invalid binary pyramid');
+  }
+
+  const PixelArray = (fullResolution.data as TypedArray)
+    .constructor as TypedArrayConstructor;
+  let offset = bytes.byteOffset + 8;
+  const levels: Image[] = [];
+  for (let i = 0; i < count; i++) {
+    const size = Array.from(new Uint32Array(bytes.buffer, offset, 3));
+    const geometry = new Float64Array(bytes.buffer, offset + 16, 6);
+    offset += 64;
+
+    const level = new Image(fullResolution.imageType);
+    level.name = fullResolution.name;
+    level.size = size;
+    level.spacing = Array.from(geometry.subarray(0, 3));
+    level.origin = Array.from(geometry.subarray(3, 6));
+    level.direction = fullResolution.direction.slice();
+    const pixelCount = size[0] * size[1] * size[2];
+    level.data = new PixelArray(bytes.buffer, offset, pixelCount);
+    offset += Math.ceil(level.data.byteLength / 8) * 8;
+    levels.push(level);
+  }
+  return levels;
+}
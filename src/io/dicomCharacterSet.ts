@@ -0,0 +1,148 @@
+// Decoding of DICOM string values from their Specific Character Set
+// (0008,0005), with the ISO 2022 code extensions of PS3.5 6.1.2.5.
+
+const ESC = 0x1b;
+
+// Pseudo labels for the multi-byte G0 sets of ISO 2022 IR 87 and 159, which
+// are decoded as EUC-JP once moved to the upper half.
+const JIS_X_0208 = 'jis-x-0208';
+const JIS_X_0212 = 'jis-x-0212';
+
+// Defined terms of Specific Character Set => decoder of the text before any
+// escape sequence. Terms designating a G0 set are not active before their
+// escape sequence, so they start in ASCII.
+const CHARACTER_SETS: Record<string, string> = {
+  '': 'utf-8',
+  'ISO_IR 6': 'utf-8',
+  'ISO_IR 100': 'iso-8859-1',
+  'ISO_IR 101': 'iso-8859-2',
+  'ISO_IR 109': 'iso-8859-3',
+  'ISO_IR 110': 'iso-8859-4',
+  'ISO_IR 144': 'iso-8859-5',
+  'ISO_IR 127': 'iso-8859-6',
+  'ISO_IR 126': 'iso-8859-7',
+  'ISO_IR 138': 'iso-8859-8',
+  'ISO_IR 148': 'iso-8859-9',
+  'ISO_IR 166': 'windows-874',
+  'ISO_IR 13': 'shift_jis',
+  'ISO_IR 192': 'utf-8',
+  GB18030: 'gb18030',
+  GBK: 'gbk',
+  'ISO 2022 IR 6': 'utf-8',
+  'ISO 2022 IR 100': 'iso-8859-1',
+  'ISO 2022 IR 101': 'iso-8859-2',
+  'ISO 2022 IR 109': 'iso-8859-3',
+  'ISO 2022 IR 110': 'iso-8859-4',
+  'ISO 2022 IR 144': 'iso-8859-5',
+  'ISO 2022 IR 127': 'iso-8859-6',
+  'ISO 2022 IR 126': 'iso-8859-7',
+  'ISO 2022 IR 138': 'iso-8859-8',
+  'ISO 2022 IR 148': 'iso-8859-9',
+  'ISO 2022 IR 166': 'windows-874',
+  'ISO 2022 IR 13': 'shift_jis',
+  'ISO 2022 IR 87': 'utf-8',
+  'ISO 2022 IR 159': 'utf-8',
+  // KS X 1001 and GB 2312 in G1 are EUC-KR and GB 2312 as stored
+  'ISO 2022 IR 149': 'euc-kr',
+  'ISO 2022 IR 58': 'gb18030',
+};
+
+// Escape sequences, without their ESC, => decoder of the text they switch to
+const ESCAPE_SEQUENCES: Record<string, string> = {
+  '(B': 'utf-8',
+  // JIS X 0201 Romaji and Katakana
+  '(J': 'shift_jis',
+  ')I': 'shift_jis',
+  $B: JIS_X_0208,
+  // JIS C 6226-1978, which JIS X 0208 supersedes
+  '$@': JIS_X_0208,
+  '$(D': JIS_X_0212,
+  '$)C': 'euc-kr',
+  '$)A': 'gb18030',
+  '-A': 'iso-8859-1',
+  '-B': 'iso-8859-2',
+  '-C': 'iso-8859-3',
+  '-D': 'iso-8859-4',
+  '-L': 'iso-8859-5',
+  '-G': 'iso-8859-6',
+  '-F': 'iso-8859-7',
+  '-H': 'iso-8859-8',
+  '-M': 'iso-8859-9',
+  '-T': 'windows-874',
+};
+
+const ESCAPE_SEQUENCE_BYTES = Object.keys(ESCAPE_SEQUENCES).map(
+  (sequence) =>
+    [sequence, Array.from(sequence, (c) => c.charCodeAt(0))] as const
+);
+
+const decoders = new Map<string, TextDecoder>();
+function getDecoder(label: string) {
+  if (!decoders.has(label)) {
+    decoders.set(label, new TextDecoder(label));
+  }
+  return decoders.get(label)!;
+}
+
+// Returns the escape sequence starting at bytes[start], just past its ESC.
+function matchEscapeSequence(bytes: Uint8Array, start: number) {
+  const match = ESCAPE_SEQUENCE_BYTES.find(([, sequence]) =>
+    sequence.every((byte, i) => bytes[start + i] === byte)
+  );
+  return match?.[0];
+}
+
+function decodeSegment(bytes: Uint8Array, label: string) {
+  if (label === JIS_X_0208 || label === JIS_X_0212) {
+    // EUC-JP stores both sets with their bytes in the upper half, and JIS X
+    // 0212 characters after an SS3 byte
+    const euc: number[] = [];
+    for (let i = 0; i + 1 < bytes.length; i += 2) {
+      if (label === JIS_X_0212) euc.push(0x8f);
+      euc.push(bytes[i] | 0x80, bytes[i + 1] | 0x80);
+    }
+    return getDecoder('euc-jp').decode(new Uint8Array(euc));
+  }
+  return getDecoder(label).decode(bytes);
+}
+
+/**
+ * Decodes a string value stored in the given Specific Character Set.
+ *
+ * The first term sets the character set the value starts in. With code
+ * extensions, escape sequences in the value switch to the character sets of
+ * the other terms, so each run of text between them is decoded on its own.
+ * Unknown terms are read as UTF-8, and unknown escape sequences are dropped.
+ * @param bytes the value as stored, without its trailing padding
+ * @param specificCharacterSet the value of (0008,0005)
+ * @returns
+ */
+export function decodeDicomString(
+  bytes: Uint8Array,
+  specificCharacterSet: string
+) {
+  const firstTerm = specificCharacterSet.split('\\')[0].trim();
+  let label = CHARACTER_SETS[firstTerm] ?? 'utf-8';
+  if (!bytes.includes(ESC)) {
+    return decodeSegment(bytes, label);
+  }
+
+  let text = '';
+  let start = 0;
+  let i = 0;
+  while (i < bytes.length) {
+    if (bytes[i] !== ESC) {
+      i += 1;
+    } else {
+      text += decodeSegment(bytes.subarray(start, i), label);
+      const sequence = matchEscapeSequence(bytes, i + 1);
+      i += 1;
+      if (sequence) {
+        label = ESCAPE_SEQUENCES[sequence];
+        i += sequence.length;
+      }
+      start = i;
+    }
+  }
+  return text + decodeSegment(bytes.subarray(start), label);
+}
@@ -0,0 +1,127 @@
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../categorize.hpp"
+#include "expect.hpp"
+
+static const Cosines Axial{1, 0, 0, 0, 1, 0};
+static const Cosines Coronal{1, 0, 0, 0, 0, -1};
+
+DICOMFileRecord makeRecord(const std::string &fileName,
+                           const std::string &seriesID, const Cosines &cosines,
+                           double z) {
+  DICOMFileRecord record;
+  record.fileName = fileName;
+  record.seriesUID = "1.2.3";
+  record.seriesID = seriesID;
+  record.cosines = cosines;
+  record.position = {0, 0, z};
+  record.dimensions = {4, 4, 1};
+  record.spacing = {1, 1, 1};
+  return record;
+}
+
+// file names of the volume whose ID starts with prefix, or empty
+std::vector<std::string> volumeFiles(const VolumeRecordsMapType &volumes,
+                                     const std::string &prefix) {
+  std::vector<std::string> fileNames;
+  for (const auto &[volumeID, records] : volumes) {
+    if (volumeID.rfind(prefix, 0) == 0) {
+      for (const auto *record : records) {
+        fileNames.push_back(record->fileName);
+      }
+    }
+  }
+  return fileNames;
+}
+
+void testSequencesSharingSeriesUID() {
+  // Two MR sequences of one series UID and orientation, told apart by their
+  // sequence name and rows/columns in the detailed series ID.
+  VolumeCategorizer categorizer;
+  categorizer.Add({
+      makeRecord("t1-1", "1.2.3.1t1256256", Axial, 1),
+      makeRecord("t2-1", "1.2.3.1t2512512", Axial, 1),
+      makeRecord("t1-0", "1.2.3.1t1256256", Axial, 0),
+      makeRecord("t2-0", "1.2.3.1t2512512", Axial, 0),
+  });
+
+  const auto volumes = categorizer.GetVolumes();
+  EXPECT(volumes.size() == 2);
+  EXPECT((volumeFiles(volumes, "1.2.3.1t1256256.") ==
+          std::vector<std::string>{"t1-0", "t1-1"}));
+  EXPECT((volumeFiles(volumes, "1.2.3.1t2512512.") ==
+          std::vector<std::string>{"t2-0", "t2-1"}));
+}
+
+void testOrientationsWithinSeries() {
+  VolumeCategorizer categorizer;
+  auto added = categorizer.Add({
+      makeRecord("axial", "1.2.3", Axial, 0),
+      makeRecord("coronal", "1.2.3", Coronal, 0),
+  });
+  EXPECT(added.size() == 2);
+
+  // A later batch lands in the volume already handed out.
+  added = categorizer.Add({makeRecord("axial-2", "1.2.3", Axial, 1)});
+  EXPECT(added.size() == 1);
+  const auto volumes = categorizer.GetVolumes();
+  EXPECT(volumes.size() == 2);
+  EXPECT(volumes.count(added.begin()->first) == 1);
+  EXPECT(volumes.at(added.begin()->first).size() == 2);
+}
+
+void testEvenSlicePositions() {
+  const auto diagnostics = AnalyzeSlicePositions({0, 2.5, 5, 7.5, 10});
+  EXPECT(diagnostics.duplicatePositions == 0);
+  EXPECT(diagnostics.missingSlices == 0);
+  EXPECT(diagnostics.nominalSpacing == 2.5);
+  EXPECT(!diagnostics.irregularSpacing);
+
+  // too few slices to tell
+  EXPECT(AnalyzeSlicePositions({3}).nominalSpacing == 0);
+  EXPECT(AnalyzeSlicePositions({}).duplicatePositions == 0);
+}
+
+void testDuplicateSlicePositions() {
+  // an exact repeat, and one off by rounding noise
+  const auto diagnostics = AnalyzeSlicePositions({0, 1, 1, 2, 2.0001, 3});
+  EXPECT(diagnostics.duplicatePositions == 2);
+  EXPECT(diagnostics.missingSlices == 0);
+  EXPECT(diagnostics.nominalSpacing == 1);
+  EXPECT(!diagnostics.irregularSpacing);
+
+  EXPECT(AnalyzeSlicePositions({4, 4, 4}).duplicatePositions == 2);
+}
+
+void testMissingSlices() {
+  // slices 3 and 4, then 7, are missing
+  const auto diagnostics = AnalyzeSlicePositions({0, 1, 2, 5, 6, 8, 9});
+  EXPECT(diagnostics.duplicatePositions == 0);
+  EXPECT(diagnostics.missingSlices == 3);
+  EXPECT(diagnostics.nominalSpacing == 1);
+  EXPECT(diagnostics.maxSpacing == 3);
+  EXPECT(diagnostics.irregularSpacing);
+}
+
+void testIrregularSpacing() {
+  // uneven, but no gap wide enough to hide a slice
+  const auto diagnostics = AnalyzeSlicePositions({0, 1, 2.2, 3.2, 4.2});
+  EXPECT(diagnostics.missingSlices == 0);
+  EXPECT(diagnostics.irregularSpacing);
+  EXPECT(std::abs(diagnostics.maxSpacing - 1.2) < 1e-9);
+}
+
+int main() {
+  testSequencesSharingSeriesUID();
+  testOrientationsWithinSeries();
+  testEvenSlicePositions();
+  testDuplicateSlicePositions();
+  testMissingSlices();
+  testIrregularSpacing();
+
+  return expectResult();
+}
@@ -0,0 +1,102 @@
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include "../cosines.hpp"
+#include "expect.hpp"
+
+static const Cosines Axial{1, 0, 0, 0, 1, 0};
+static const Cosines Coronal{1, 0, 0, 0, 0, -1};
+static const Cosines Sagittal{0, 1, 0, 0, 0, -1};
+
+void testRowStride() {
+  // Same row direction, different column direction: the old overlapping
+  // [i, i+1, i+2] indexing compared [0..2] and [1..3] only.
+  EXPECT(!areCosinesAlmostEqual(Axial, Coronal));
+  EXPECT(!areCosinesAlmostEqual(Coronal, Sagittal));
+  EXPECT(areCosinesAlmostEqual(Axial, Axial));
+
+  // Only elements 4 and 5 differ.
+  const Cosines tilted{1, 0, 0, 0, 0.6, 0.8};
+  EXPECT(!areCosinesAlmostEqual(Axial, tilted));
+}
+
+void testEpsilon() {
+  // 1 degree tilt of the column direction: dot = cos(1deg) ~ 0.99985
+  const double c = std::cos(M_PI / 180);
+  const double s = std::sin(M_PI / 180);
+  const Cosines tilted{1, 0, 0, 0, c, s};
+
+  EXPECT(!areCosinesAlmostEqual(Axial, tilted));
+  EXPECT(!areCosinesAlmostEqual(Axial, tilted, 1e-4));
+  EXPECT(areCosinesAlmostEqual(Axial, tilted, 1e-3));
+
+  // Rounding noise in the stored values.
+  const Cosines noisy{0.999999, 0.000001, 0, 0, 0.999999, -0.000002};
+  EXPECT(areCosinesAlmostEqual(Axial, noisy));
+}
+
+void testBatch() {
+  const std::vector<Cosines> candidates{Sagittal, Coronal, Axial, Axial};
+  EXPECT(findAlmostEqualCosines(Axial, candidates.data(), candidates.size()) ==
+         2);
+  EXPECT(findAlmostEqualCosines(Sagittal, candidates.data(),
+                                candidates.size()) == 0);
+  EXPECT(findAlmostEqualCosines(Axial, candidates.data(), 2) == 2);
+  EXPECT(findAlmostEqualCosines(Axial, candidates.data(), 0) == 0);
+
+  // Batch and scalar comparisons agree, including around the threshold.
+  for (int i = 0; i <= 200; i++) {
+    const double angle = i * 0.0001;
+    const Cosines tilted{std::cos(angle), std::sin(angle), 0,
+                         -std::sin(angle), std::cos(angle), 0};
+    EXPECT((findAlmostEqualCosines(Axial, &tilted, 1) == 0) ==
+           areCosinesAlmostEqual(Axial, tilted));
+  }
+}
+
+void testOrientationBuckets() {
+  OrientationBuckets buckets;
+  EXPECT(buckets.Find(Axial) == OrientationBuckets::NotFound);
+  EXPECT(buckets.Insert(Axial) == 0);
+  EXPECT(buckets.Insert(Coronal) == 1);
+
+  EXPECT(buckets.Find(Axial) == 0);
+  EXPECT(buckets.Find(Coronal) == 1);
+  EXPECT(buckets.Find(Sagittal) == OrientationBuckets::NotFound);
+
+  // Matches across a cell border: -0.000001 and 0.000001 quantize into
+  // different cells around 0.
+  const Cosines nearZero{1, -0.000001, 0.000001, -0.000001, 1, 0.000001};
+  EXPECT(buckets.Find(nearZero) == 0);
+
+  // The hash gives the same answer as a linear scan in insertion order.
+  std::vector<Cosines> inserted{Axial, Coronal};
+  for (int i = 0; i < 500; i++) {
+    const double angle = (i % 50) * 0.003 + (i / 50) * 0.0001;
+    const Cosines cosines{std::cos(angle), std::sin(angle), 0,
+                          -std::sin(angle), std::cos(angle), 0};
+
+    size_t expected =
+        findAlmostEqualCosines(cosines, inserted.data(), inserted.size());
+    if (expected == inserted.size()) {
+      expected = OrientationBuckets::NotFound;
+    }
+    const size_t found = buckets.Find(cosines);
+    EXPECT(found == expected);
+    if (found == OrientationBuckets::NotFound) {
+      EXPECT(buckets.Insert(cosines) == inserted.size());
+      inserted.push_back(cosines);
+    }
+  }
+  EXPECT(buckets.Size() == inserted.size());
+}
+
+int main() {
+  testRowStride();
+  testEpsilon();
+  testBatch();
+  testOrientationBuckets();
+
+  return expectResult();
+}
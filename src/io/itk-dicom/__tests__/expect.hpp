@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdlib>
+#include <iostream>
+
+/**
+ * Number of failed EXPECT checks so far. Specs keep going past a failure, so
+ * one run reports every check that fails.
+ */
+inline int &expectFailures() {
+  static int failures = 0;
+  return failures;
+}
+
+#define EXPECT(cond)                                                           \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      std::cerr << __FILE__ << ":" << __LINE__ << ": expected " #cond          \
+                << std::endl;                                                  \
+      expectFailures()++;                                                      \
+    }                                                                          \
+  } while (0)
+
+/**
+ * Exit status of a spec, after reporting how many checks failed.
+ */
+inline int expectResult() {
+  if (expectFailures()) {
+    std::cerr << expectFailures() << " failure(s)" << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
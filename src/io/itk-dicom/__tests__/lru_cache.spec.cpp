@@ -0,0 +1,63 @@
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "../lru_cache.hpp"
+#include "expect.hpp"
+
+void testHitsAndMisses() {
+  LRUCache<int> cache(100);
+  EXPECT(cache.Get("a") == nullptr);
+  cache.Put("a", 1, 10);
+  const int *value = cache.Get("a");
+  EXPECT(value != nullptr && *value == 1);
+  EXPECT(cache.Hits() == 1);
+  EXPECT(cache.Misses() == 1);
+}
+
+void testEvictsLeastRecentlyUsed() {
+  LRUCache<int> cache(30);
+  cache.Put("a", 1, 10);
+  cache.Put("b", 2, 10);
+  cache.Put("c", 3, 10);
+
+  // "a" becomes the most recently used, so "b" goes first.
+  cache.Get("a");
+  cache.Put("d", 4, 10);
+  EXPECT(cache.Get("b") == nullptr);
+  EXPECT(cache.Get("a") != nullptr);
+  EXPECT(cache.Get("c") != nullptr);
+  EXPECT(cache.Get("d") != nullptr);
+  EXPECT(cache.Bytes() == 30);
+
+  // A larger value can evict several.
+  cache.Put("e", 5, 25);
+  EXPECT(cache.Size() == 1);
+  EXPECT(cache.Bytes() == 25);
+}
+
+void testReplaceAndBudget() {
+  LRUCache<std::string> cache(100);
+  cache.Put("a", "one", 40);
+  cache.Put("a", "uno", 50);
+  EXPECT(cache.Size() == 1);
+  EXPECT(cache.Bytes() == 50);
+  EXPECT(*cache.Get("a") == "uno");
+
+  // Values over the budget are not cached, and do not evict others.
+  cache.Put("big", "big", 101);
+  EXPECT(cache.Get("big") == nullptr);
+  EXPECT(cache.Get("a") != nullptr);
+
+  cache.SetBudget(10);
+  EXPECT(cache.Size() == 0);
+  EXPECT(cache.Bytes() == 0);
+}
+
+int main() {
+  testHitsAndMisses();
+  testEvictsLeastRecentlyUsed();
+  testReplaceAndBudget();
+
+  return expectResult();
+}
@@ -0,0 +1,66 @@
+#include <array>
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include "../pyramid.hpp"
+#include "expect.hpp"
+
+// Stands in for itk::Size<3>.
+struct Size : std::array<size_t, 3> {
+  static constexpr unsigned int Dimension = 3;
+};
+
+static Size size(size_t x, size_t y, size_t z) {
+  Size s;
+  s[0] = x;
+  s[1] = y;
+  s[2] = z;
+  return s;
+}
+
+void testAllLevels() {
+  const auto sizes = pyramidLevelSizes(size(512, 512, 100), 0);
+  const std::vector<Size> expected{
+      size(256, 256, 50), size(128, 128, 25), size(64, 64, 12),
+      size(32, 32, 6),    size(16, 16, 3),    size(8, 8, 1),
+      size(4, 4, 1),      size(2, 2, 1),      size(1, 1, 1)};
+  EXPECT(sizes == expected);
+}
+
+void testOddSizes() {
+  // halving rounds down, and axes of one voxel are kept
+  const auto sizes = pyramidLevelSizes(size(7, 3, 1), 0);
+  const std::vector<Size> expected{size(3, 1, 1), size(1, 1, 1)};
+  EXPECT(sizes == expected);
+}
+
+void testLevelCount() {
+  // levels counts the full resolution level too
+  const auto two = pyramidLevelSizes(size(64, 64, 64), 2);
+  EXPECT(two.size() == 1);
+  EXPECT(two[0] == size(32, 32, 32));
+
+  const auto four = pyramidLevelSizes(size(64, 64, 64), 4);
+  EXPECT(four.size() == 3);
+  EXPECT(four.back() == size(8, 8, 8));
+
+  EXPECT(pyramidLevelSizes(size(64, 64, 64), 1).empty());
+
+  // stops at one voxel, even when more levels are asked for
+  EXPECT(pyramidLevelSizes(size(4, 2, 1), 10).size() == 2);
+}
+
+void testSingleVoxel() {
+  EXPECT(pyramidLevelSizes(size(1, 1, 1), 0).empty());
+}
+
+int main() {
+  testAllLevels();
+  testOddSizes();
+  testLevelCount();
+  testSingleVoxel();
+
+  return expectResult();
+}
@@ -0,0 +1,132 @@
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "../uint8_kernels.hpp"
+#include "expect.hpp"
+
+void testMapping() {
+  const float values[] = {-10, 0, 0.5f, 1, 127.9f, 255, 300, NAN};
+  const size_t count = sizeof(values) / sizeof(values[0]);
+  uint8_t output[count];
+
+  mapToUint8(values, count, uint8Mapping(0, 255, false), output);
+  const uint8_t expected[] = {0, 0, 0, 1, 127, 255, 255, 0};
+  for (size_t i = 0; i < count; i++) {
+    EXPECT(output[i] == expected[i]);
+  }
+
+  mapToUint8(values, count, uint8Mapping(0, 255, true), output);
+  EXPECT(output[0] == 255);
+  EXPECT(output[1] == 255);
+  EXPECT(output[5] == 0);
+  EXPECT(output[6] == 0);
+
+  // an empty range maps to the low end of the output
+  mapToUint8(values, count, uint8Mapping(5, 5, false), output);
+  EXPECT(output[6] == 0);
+  mapToUint8(values, count, uint8Mapping(5, 5, true), output);
+  EXPECT(output[6] == 255);
+}
+
+// The SIMD float paths must match the generic ones, whatever the length.
+void testMatchesGeneric() {
+  std::mt19937 random(42);
+  std::uniform_real_distribution<float> intensity(-1500, 3000);
+  for (size_t count : {0, 1, 3, 4, 15, 16, 17, 1000, 1027}) {
+    std::vector<float> values(count);
+    std::vector<double> doubles(count);
+    for (size_t i = 0; i < count; i++) {
+      values[i] = intensity(random);
+      doubles[i] = values[i];
+    }
+
+    double minimum, maximum, expectedMinimum, expectedMaximum;
+    minMaxIntensity(values.data(), count, minimum, maximum);
+    minMaxIntensity(doubles.data(), count, expectedMinimum, expectedMaximum);
+    EXPECT(minimum == expectedMinimum);
+    EXPECT(maximum == expectedMaximum);
+
+    for (bool inverted : {false, true}) {
+      const auto mapping = uint8Mapping(-160, 240, inverted);
+      std::vector<uint8_t> output(count);
+      std::vector<uint8_t> expected(count);
+      mapToUint8(values.data(), count, mapping, output.data());
+      mapToUint8(doubles.data(), count, mapping, expected.data());
+      EXPECT(output == expected);
+    }
+  }
+}
+
+// Thumbnails map slices in their stored integer types too, with SIMD paths
+// for 16-bit types that must match the generic ones.
+template <typename T> void testNativeType(int low, int high) {
+  std::mt19937 random(7);
+  std::uniform_int_distribution<int> intensity(low, high);
+  for (size_t count : {0, 1, 7, 8, 9, 15, 16, 17, 1000, 1027}) {
+    std::vector<T> values(count);
+    std::vector<double> doubles(count);
+    for (size_t i = 0; i < count; i++) {
+      values[i] = static_cast<T>(intensity(random));
+      doubles[i] = values[i];
+    }
+
+    double minimum, maximum, expectedMinimum, expectedMaximum;
+    minMaxIntensity(values.data(), count, minimum, maximum);
+    minMaxIntensity(doubles.data(), count, expectedMinimum, expectedMaximum);
+    EXPECT(minimum == expectedMinimum);
+    EXPECT(maximum == expectedMaximum);
+
+    for (bool inverted : {false, true}) {
+      const auto mapping = uint8Mapping(minimum, maximum, inverted);
+      std::vector<uint8_t> output(count);
+      std::vector<uint8_t> expected(count);
+      mapToUint8(values.data(), count, mapping, output.data());
+      mapToUint8(doubles.data(), count, mapping, expected.data());
+      EXPECT(output == expected);
+    }
+  }
+}
+
+// Extremes of the 16-bit types, past where a signed compare of uint16_t
+// would order them wrongly.
+void testExtremes() {
+  const uint16_t unsignedValues[] = {40000, 3,     65535, 0,    32767,
+                                     32768, 12345, 50000, 1,    65534,
+                                     2,     32769, 100,   200,  300,
+                                     400,   500};
+  double minimum, maximum;
+  minMaxIntensity(unsignedValues, 17, minimum, maximum);
+  EXPECT(minimum == 0);
+  EXPECT(maximum == 65535);
+
+  const int16_t signedValues[] = {-32768, 5,   32767, -1,  0,   1,
+                                  -2,     2,   -3,    3,   -4,  4,
+                                  -5,     100, -100,  200, -200};
+  minMaxIntensity(signedValues, 17, minimum, maximum);
+  EXPECT(minimum == -32768);
+  EXPECT(maximum == 32767);
+
+  uint8_t output[17];
+  mapToUint8(unsignedValues, 17, uint8Mapping(0, 65535, false), output);
+  EXPECT(output[2] == 255);
+  EXPECT(output[3] == 0);
+  mapToUint8(signedValues, 17, uint8Mapping(-32768, 32767, false), output);
+  EXPECT(output[0] == 0);
+  EXPECT(output[2] == 255);
+}
+
+int main() {
+  testMapping();
+  testMatchesGeneric();
+  testNativeType<int16_t>(-1024, 3071);
+  testNativeType<int16_t>(-32768, 32767);
+  testNativeType<uint16_t>(0, 4095);
+  testNativeType<uint16_t>(0, 65535);
+  testNativeType<uint8_t>(0, 255);
+  testExtremes();
+
+  return expectResult();
+}
@@ -0,0 +1,391 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "cosines.hpp"
+
+inline void replaceChars(std::string &str, char search, char replaceChar) {
+  size_t pos;
+  std::string replace(1, replaceChar);
+  while ((pos = str.find(search)) != std::string::npos) {
+    str.replace(pos, 1, replace);
+  }
+}
+
+/**
+ * Header fields of a single DICOM file needed to categorize it.
+ *
+ * Filled once by ScanDICOMFile so that no later grouping stage has to open
+ * the file again.
+ */
+struct DICOMFileRecord {
+  std::string fileName;
+  // Position of the file among all the files given to the categorization.
+  uint32_t fileIndex = 0;
+  // 0020|000e Series Instance UID, stripped like gdcm::SerieHelper does.
+  std::string seriesUID;
+  // seriesUID refined by the series details (see SeriesDetailTags).
+  std::string seriesID;
+  // 0020|0037 Image Orientation (Patient)
+  Cosines cosines;
+  // 0020|0032 Image Position (Patient)
+  std::array<double, 3> position;
+  // Columns, Rows and Number of Frames
+  std::array<unsigned int, 3> dimensions;
+  // Pixel spacing along the rows and columns, then between frames, as
+  // itk::GDCMImageIO would report it.
+  std::array<double, 3> spacing;
+  // 0020|0013 Instance Number, 0 if missing.
+  int instanceNumber = 0;
+};
+
+// Records of a single volume. Pointers are owned by the scanned record list.
+using RecordList = std::vector<const DICOMFileRecord *>;
+// volumeID -> records[]
+using VolumeRecordsMapType = std::unordered_map<std::string, RecordList>;
+
+// Fraction of the nominal slice spacing under which consecutive positions are
+// duplicates, and within which slice spacings are considered equal.
+constexpr double SliceSpacingTolerance = 0.01;
+
+/**
+ * Problems found in the slice positions of a volume. Any of them makes the
+ * built image distorted, as it assumes evenly spaced slices.
+ */
+struct SliceDiagnostics {
+  // slices at the same position as the previous slice
+  unsigned int duplicatePositions = 0;
+  // slices estimated to be missing from gaps of over 1.5 nominal spacings
+  unsigned int missingSlices = 0;
+  // median distance between distinct consecutive positions
+  double nominalSpacing = 0;
+  // extremes of the distance between distinct consecutive positions
+  double minSpacing = 0;
+  double maxSpacing = 0;
+  // true if minSpacing and maxSpacing differ by more than the tolerance
+  bool irregularSpacing = false;
+};
+
+/**
+ * Analyzes the gaps between sorted slice positions along the normal.
+ */
+inline SliceDiagnostics
+AnalyzeSlicePositions(const std::vector<double> &positions) {
+  SliceDiagnostics diagnostics;
+  if (positions.size() < 2) {
+    return diagnostics;
+  }
+
+  auto median = [](std::vector<double> values) {
+    auto middle = values.begin() + values.size() / 2;
+    std::nth_element(values.begin(), middle, values.end());
+    return *middle;
+  };
+
+  std::vector<double> steps;
+  for (size_t i = 1; i < positions.size(); i++) {
+    const double step = positions[i] - positions[i - 1];
+    if (step > 0) {
+      steps.push_back(step);
+    }
+  }
+  if (steps.empty()) {
+    diagnostics.duplicatePositions = positions.size() - 1;
+    return diagnostics;
+  }
+
+  // Steps far below the typical one are rounding noise on a repeated position.
+  const double duplicateThreshold = SliceSpacingTolerance * median(steps);
+  std::vector<double> distinct;
+  for (const double step : steps) {
+    if (step >= duplicateThreshold) {
+      distinct.push_back(step);
+    }
+  }
+  diagnostics.duplicatePositions = positions.size() - 1 - distinct.size();
+
+  const double nominal = median(distinct);
+  const auto [min, max] = std::minmax_element(distinct.begin(), distinct.end());
+  diagnostics.nominalSpacing = nominal;
+  diagnostics.minSpacing = *min;
+  diagnostics.maxSpacing = *max;
+  diagnostics.irregularSpacing =
+      *max - *min > SliceSpacingTolerance * nominal;
+
+  for (const double step : distinct) {
+    if (step > 1.5 * nominal) {
+      diagnostics.missingSlices +=
+          static_cast<unsigned int>(std::lround(step / nominal)) - 1;
+    }
+  }
+
+  return diagnostics;
+}
+
+/**
+ * Layout of the slices of a volume, computed while ordering its files, and
+ * the geometry of the image they build.
+ */
+struct VolumeGeometry {
+  // true if the files are ordered on their position along the slice normal
+  bool sortedByPosition = false;
+  // Mean distance between consecutive slices along the normal, 0 if the files
+  // are not ordered on position.
+  double sliceSpacing = 0;
+  // Analysis of the sorted positions, even if they could not order the files.
+  SliceDiagnostics diagnostics;
+
+  // Image geometry, as itk::ImageSeriesReader will output it.
+  std::array<unsigned int, 3> size{};
+  std::array<double, 3> spacing{};
+  std::array<double, 3> origin{};
+  // Row-major, with the row, column and slice directions as columns.
+  std::array<double, 9> direction{};
+};
+
+// volumeID -> geometry
+using VolumeGeometryMapType = std::unordered_map<std::string, VolumeGeometry>;
+
+inline std::array<double, 3> sliceNormal(const Cosines &cosines) {
+  return {
+      cosines[1] * cosines[5] - cosines[2] * cosines[4],
+      cosines[2] * cosines[3] - cosines[0] * cosines[5],
+      cosines[0] * cosines[4] - cosines[1] * cosines[3],
+  };
+}
+
+// Sorts on the Image Position (Patient) projected on the slice normal. Fails
+// if positions are not unique, like
+// gdcm::SerieHelper::ImagePositionPatientOrdering.
+inline bool OrderByImagePosition(RecordList &records,
+                                 VolumeGeometry &geometry) {
+  const auto normal = sliceNormal(records.front()->cosines);
+
+  std::vector<std::pair<double, const DICOMFileRecord *>> distances;
+  distances.reserve(records.size());
+  for (const auto *record : records) {
+    const auto &ipp = record->position;
+    const double dist =
+        normal[0] * ipp[0] + normal[1] * ipp[1] + normal[2] * ipp[2];
+    distances.emplace_back(dist, record);
+  }
+
+  std::stable_sort(
+      distances.begin(), distances.end(),
+      [](const auto &a, const auto &b) { return a.first < b.first; });
+
+  std::vector<double> positions;
+  positions.reserve(distances.size());
+  for (const auto &distance : distances) {
+    positions.push_back(distance.first);
+  }
+  geometry.diagnostics = AnalyzeSlicePositions(positions);
+
+  if (distances.front().first == distances.back().first) {
+    return false;
+  }
+  for (size_t i = 1; i < distances.size(); i++) {
+    if (distances[i].first == distances[i - 1].first) {
+      return false;
+    }
+  }
+
+  for (size_t i = 0; i < distances.size(); i++) {
+    records[i] = distances[i].second;
+  }
+  geometry.sortedByPosition = true;
+  geometry.sliceSpacing = (distances.back().first - distances.front().first) /
+                          (distances.size() - 1);
+  return true;
+}
+
+// Sorts on Instance Number if the numbers look coherent, like
+// gdcm::SerieHelper::ImageNumberOrdering.
+inline bool OrderByInstanceNumber(RecordList &records) {
+  int min = records.front()->instanceNumber;
+  int max = min;
+  for (const auto *record : records) {
+    min = std::min(min, record->instanceNumber);
+    max = std::max(max, record->instanceNumber);
+  }
+
+  const int count = static_cast<int>(records.size());
+  if (min == max || max == 0 || max >= 2 * count + min) {
+    return false;
+  }
+
+  std::stable_sort(records.begin(), records.end(),
+                   [](const auto *a, const auto *b) {
+                     return a->instanceNumber < b->instanceNumber;
+                   });
+  return true;
+}
+
+/**
+ * Derives the image geometry of ordered records from their headers.
+ *
+ * The first file gives the origin and in-plane layout. Slices are the frames
+ * of every file, spaced by the sorted slice spacing, or by the spacing of the
+ * first file when position could not order the files.
+ */
+inline void SetVolumeImageGeometry(const RecordList &records,
+                                   VolumeGeometry &geometry) {
+  const auto &first = *records.front();
+
+  unsigned int slices = 0;
+  for (const auto *record : records) {
+    slices += std::max(record->dimensions[2], 1u);
+  }
+  geometry.size = {first.dimensions[0], first.dimensions[1], slices};
+
+  geometry.spacing = first.spacing;
+  if (geometry.sortedByPosition) {
+    geometry.spacing[2] = geometry.sliceSpacing;
+  }
+
+  geometry.origin = first.position;
+
+  const auto &cosines = first.cosines;
+  const auto normal = sliceNormal(cosines);
+  for (int row = 0; row < 3; row++) {
+    geometry.direction[row * 3 + 0] = cosines[row];
+    geometry.direction[row * 3 + 1] = cosines[3 + row];
+    geometry.direction[row * 3 + 2] = normal[row];
+  }
+}
+
+/**
+ * Orders the files of a volume the way itk::GDCMSeriesFileNames orders a
+ * series: by image position, then by instance number, then by file name.
+ *
+ * The files of a volume share an orientation, so the slice normal of the
+ * first file holds for all of them.
+ */
+inline VolumeGeometry OrderVolumeRecords(RecordList &records) {
+  VolumeGeometry geometry;
+  if (records.empty()) {
+    return geometry;
+  }
+  if (!OrderByImagePosition(records, geometry) &&
+      !OrderByInstanceNumber(records)) {
+    std::stable_sort(records.begin(), records.end(),
+                     [](const auto *a, const auto *b) {
+                       return a->fileName < b->fileName;
+                     });
+  }
+  SetVolumeImageGeometry(records, geometry);
+  return geometry;
+}
+
+// append unique ID part to the volume ID, based on cosines
+// The format replaces non-alphanumeric chars to be semi-consistent with DICOM
+// UID spec,
+//   and to make debugging easier when looking at the full volume IDs.
+// Format: COSINE || "S" || COSINE || "S" || ...
+//   COSINE: A decimal number -DD.DDDD gets reformatted into NDDSDDDD
+inline std::string encodeCosinesAsIDPart(const Cosines &cosines) {
+  std::string concatenated;
+  for (auto it = cosines.begin(); it != cosines.end(); ++it) {
+    concatenated += std::to_string(*it);
+    if (it != cosines.end() - 1) {
+      concatenated += 'S';
+    }
+  }
+
+  replaceChars(concatenated, '-', 'N');
+  replaceChars(concatenated, '.', 'D');
+
+  return concatenated;
+}
+
+/**
+ * Sorts scanned files into volumes, one batch of files at a time.
+ *
+ * Files are grouped on their detailed series ID, so files of one series UID
+ * that differ in series number, sequence name, slice thickness, rows,
+ * columns or series date are different series, as with gdcm::SerieHelper.
+ * Within a series, files are further separated on image orientation, and
+ * each orientation bucket appends the encoded cosines of its first file to
+ * the series ID. Buckets are kept per series so that IDs never leak across
+ * series.
+ *
+ * A file is placed as soon as it is added, so a volume ID handed out for an
+ * earlier batch stays valid for the rest of the categorization.
+ */
+class VolumeCategorizer {
+public:
+  /**
+   * Adds a batch of records and returns the volumes they were placed in, with
+   * only the files of this batch.
+   */
+  VolumeRecordsMapType Add(std::vector<DICOMFileRecord> records) {
+    VolumeRecordsMapType added;
+    for (auto &record : records) {
+      m_Records.push_back(std::move(record));
+      const DICOMFileRecord *stored = &m_Records.back();
+
+      auto &series = m_Series[stored->seriesID];
+
+      auto bucket = series.buckets.Find(stored->cosines);
+      if (bucket == OrientationBuckets::NotFound) {
+        bucket = series.buckets.Insert(stored->cosines);
+        series.bucketIDs.push_back(stored->seriesID + '.' +
+                                   encodeCosinesAsIDPart(stored->cosines));
+      }
+
+      series.records.push_back(stored);
+      series.recordBuckets[stored] = bucket;
+      added[series.bucketIDs[bucket]].push_back(stored);
+    }
+    return added;
+  }
+
+  /**
+   * Returns every volume, with its files ordered by OrderVolumeRecords, and
+   * optionally the geometry found while ordering them.
+   */
+  VolumeRecordsMapType
+  GetVolumes(VolumeGeometryMapType *geometryMap = nullptr) const {
+    VolumeRecordsMapType volumeMap;
+    for (const auto &[seriesID, series] : m_Series) {
+      std::vector<RecordList> bucketRecords(series.bucketIDs.size());
+      for (const auto *record : series.records) {
+        bucketRecords[series.recordBuckets.at(record)].push_back(record);
+      }
+
+      for (size_t bucket = 0; bucket < bucketRecords.size(); bucket++) {
+        const auto &volumeID = series.bucketIDs[bucket];
+        auto &records = volumeMap[volumeID] = std::move(bucketRecords[bucket]);
+        const auto geometry = OrderVolumeRecords(records);
+        if (geometryMap) {
+          (*geometryMap)[volumeID] = geometry;
+        }
+      }
+    }
+    return volumeMap;
+  }
+
+private:
+  struct SeriesState {
+    OrientationBuckets buckets;
+    // bucket index -> volumeID
+    std::vector<std::string> bucketIDs;
+    // in the order they were added
+    RecordList records;
+    std::unordered_map<const DICOMFileRecord *, size_t> recordBuckets;
+  };
+
+  // deque, so that record pointers stay valid as batches are added
+  std::deque<DICOMFileRecord> m_Records;
+  // seriesID -> series, ordered on ID like gdcm::SerieHelper
+  std::map<std::string, SeriesState> m_Series;
+};
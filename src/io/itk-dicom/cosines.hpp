@@ -0,0 +1,179 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Image Orientation (Patient): row direction in [0..2], column direction in
+// [3..5].
+using Cosines = std::array<double, 6>;
+
+static const double EPSILON = 10e-5;
+
+inline double dotProduct3(const double *vec1, const double *vec2) {
+  return vec1[0] * vec2[0] + vec1[1] * vec2[1] + vec1[2] * vec2[2];
+}
+
+/**
+ * Two orientations are equal when both their row and column directions are
+ * within epsilon of each other, as measured by the dot product.
+ */
+inline bool areCosinesAlmostEqual(const Cosines &cosines1,
+                                  const Cosines &cosines2,
+                                  double epsilon = EPSILON) {
+  const double threshold = 1 - epsilon;
+  return dotProduct3(&cosines1[0], &cosines2[0]) >= threshold &&
+         dotProduct3(&cosines1[3], &cosines2[3]) >= threshold;
+}
+
+/**
+ * Returns the index of the first candidate equal to cosines per
+ * areCosinesAlmostEqual, or count if none is.
+ *
+ * The SSE2 path computes the row and column dot products of a candidate in
+ * one register, summing in the same order as dotProduct3 so both paths agree.
+ */
+inline size_t findAlmostEqualCosines(const Cosines &cosines,
+                                     const Cosines *candidates, size_t count,
+                                     double epsilon = EPSILON) {
+#if defined(__SSE2__)
+  const __m128d threshold = _mm_set1_pd(1 - epsilon);
+  const __m128d q01 = _mm_loadu_pd(&cosines[0]);
+  const __m128d q23 = _mm_loadu_pd(&cosines[2]);
+  const __m128d q45 = _mm_loadu_pd(&cosines[4]);
+  for (size_t i = 0; i < count; i++) {
+    const double *candidate = candidates[i].data();
+    const __m128d p01 = _mm_mul_pd(q01, _mm_loadu_pd(candidate));
+    const __m128d p23 = _mm_mul_pd(q23, _mm_loadu_pd(candidate + 2));
+    const __m128d p45 = _mm_mul_pd(q45, _mm_loadu_pd(candidate + 4));
+    // (p0, p3) + (p1, p4) + (p2, p5)
+    const __m128d dots =
+        _mm_add_pd(_mm_add_pd(_mm_shuffle_pd(p01, p23, 2),
+                              _mm_shuffle_pd(p01, p45, 1)),
+                   _mm_shuffle_pd(p23, p45, 2));
+    if (_mm_movemask_pd(_mm_cmpge_pd(dots, threshold)) == 3) {
+      return i;
+    }
+  }
+  return count;
+#else
+  for (size_t i = 0; i < count; i++) {
+    if (areCosinesAlmostEqual(cosines, candidates[i], epsilon)) {
+      return i;
+    }
+  }
+  return count;
+#endif
+}
+
+/**
+ * Spatial hash of the orientations found in a single series.
+ *
+ * Cosines are quantized on a grid whose cells are wider than the largest
+ * per-component difference two cosines accepted by areCosinesAlmostEqual can
+ * have. A match is then either in the same cell or, for components lying close
+ * to a cell border, in the adjacent cell, so at most 2^6 cells are probed
+ * instead of comparing against every bucket.
+ */
+class OrientationBuckets {
+public:
+  static constexpr size_t NotFound = static_cast<size_t>(-1);
+
+  explicit OrientationBuckets(double epsilon = EPSILON)
+      : m_Epsilon(epsilon),
+        // Rows with dot >= 1 - eps differ by at most sqrt(2 eps) per
+        // component; doubled to allow for cosines that are not quite unit.
+        m_Radius(2 * std::sqrt(2 * epsilon)), m_CellSize(4 * m_Radius) {}
+
+  /**
+   * Returns the first bucket matching the cosines, or NotFound.
+   */
+  size_t Find(const Cosines &cosines) const {
+    CellKey home;
+    // -1, 0 or +1: the neighboring cell to also probe for each component
+    std::array<int, 6> neighbor;
+    for (int i = 0; i < 6; i++) {
+      const double scaled = cosines[i] / m_CellSize;
+      home[i] = static_cast<int64_t>(std::floor(scaled));
+      const double offset = (scaled - home[i]) * m_CellSize;
+      neighbor[i] =
+          offset < m_Radius ? -1 : (m_CellSize - offset < m_Radius ? 1 : 0);
+    }
+
+    size_t found = NotFound;
+    for (unsigned int mask = 0; mask < (1u << 6); mask++) {
+      CellKey key = home;
+      bool skip = false;
+      for (int i = 0; i < 6 && !skip; i++) {
+        if (mask & (1u << i)) {
+          skip = neighbor[i] == 0;
+          key[i] += neighbor[i];
+        }
+      }
+      if (skip) {
+        continue;
+      }
+
+      auto cell = m_Cells.find(key);
+      if (cell == m_Cells.end()) {
+        continue;
+      }
+      // bucket indices are ascending within a cell
+      const auto &[buckets, cellCosines] = cell->second;
+      const size_t match = findAlmostEqualCosines(
+          cosines, cellCosines.data(), cellCosines.size(), m_Epsilon);
+      if (match < buckets.size() && buckets[match] < found) {
+        found = buckets[match];
+      }
+    }
+    return found;
+  }
+
+  /**
+   * Adds a new bucket for the cosines and returns its index.
+   */
+  size_t Insert(const Cosines &cosines) {
+    CellKey key;
+    for (int i = 0; i < 6; i++) {
+      key[i] = static_cast<int64_t>(std::floor(cosines[i] / m_CellSize));
+    }
+    const size_t bucket = m_Size++;
+    auto &cell = m_Cells[key];
+    cell.first.push_back(bucket);
+    cell.second.push_back(cosines);
+    return bucket;
+  }
+
+  size_t Size() const { return m_Size; }
+
+private:
+  using CellKey = std::array<int64_t, 6>;
+
+  struct CellKeyHash {
+    size_t operator()(const CellKey &key) const {
+      size_t hash = 0;
+      for (auto coord : key) {
+        hash = hash * 31 + std::hash<int64_t>()(coord);
+      }
+      return hash;
+    }
+  };
+
+  double m_Epsilon;
+  double m_Radius;
+  double m_CellSize;
+  size_t m_Size = 0;
+  // cell -> (bucket indices, ascending; cosines of each bucket's first file)
+  std::unordered_map<CellKey,
+                     std::pair<std::vector<size_t>, std::vector<Cosines>>,
+                     CellKeyHash>
+      m_Cells;
+};
@@ -1,8 +1,15 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <cerrno>
+#include <cmath>
 #include <cstdio>
+#include <deque>
 #include <dirent.h>
 #include <fstream>
 #include <iostream>
+#include <iterator>
+#include <map>
 #include <stdexcept>
 #include <string>
 #include <sys/stat.h>
@@ -30,22 +37,39 @@ namespace fs = std::experimental::filesystem;
 #include <iostream>
 #include <nlohmann/json.hpp>
 
-#include "itkCastImageFilter.h"
+#include "itkBinShrinkImageFilter.h"
 #include "itkGDCMImageIO.h"
-#include "itkGDCMSeriesFileNames.h"
 #include "itkImage.h"
 #include "itkImageFileReader.h"
 #include "itkImageIOBase.h"
 #include "itkImageSeriesReader.h"
-#include "itkRescaleIntensityImageFilter.h"
+#include "itkLinearInterpolateImageFunction.h"
+#include "itkJPEGImageIO.h"
+#include "itkMetaDataObject.h"
+#include "itkMultiThreaderBase.h"
+#include "itkPNGImageIO.h"
+#include "itkResampleImageFilter.h"
 #include "itkVectorImage.h"
 
+#include "itkInputImage.h"
+#include "itkOutputBinaryStream.h"
 #include "itkOutputImage.h"
 #include "itkOutputTextStream.h"
 #include "itkPipeline.h"
+#include "itkSupportInputImageTypes.h"
 
+#include "gdcmAttribute.h"
+#include "gdcmBoxRegion.h"
 #include "gdcmImageHelper.h"
+#include "gdcmImageRegionReader.h"
 #include "gdcmReader.h"
+#include "gdcmStringFilter.h"
+
+#include "categorize.hpp"
+#include "cosines.hpp"
+#include "lru_cache.hpp"
+#include "pyramid.hpp"
+#include "uint8_kernels.hpp"
 
 using json = nlohmann::json;
 using ImageType = itk::Image<float, 3>;
@@ -58,8 +82,6 @@ using VolumeMapType = std::unordered_map<std::string, std::vector<std::string>>;
 // VolumeID[]
 using VolumeIDList = std::vector<std::string>;
 
-static const double EPSILON = 10e-5;
-
 #ifdef WEB_BUILD
 extern "C" const char *EMSCRIPTEN_KEEPALIVE unpack_error_what(intptr_t ptr) {
   auto error = reinterpret_cast<std::runtime_error *>(ptr);
@@ -67,102 +89,207 @@ extern "C" const char *EMSCRIPTEN_KEEPALIVE unpack_error_what(intptr_t ptr) {
 }
 #endif
 
-void replaceChars(std::string &str, char search, char replaceChar) {
-  int pos;
-  std::string replace(1, replaceChar);
-  while ((pos = str.find(search)) != std::string::npos) {
-    str.replace(pos, 1, replace);
-  }
+void to_json(json &j, const SliceDiagnostics &diagnostics) {
+  j = json{{"duplicatePositions", diagnostics.duplicatePositions},
+           {"missingSlices", diagnostics.missingSlices},
+           {"nominalSpacing", diagnostics.nominalSpacing},
+           {"minSpacing", diagnostics.minSpacing},
+           {"maxSpacing", diagnostics.maxSpacing},
+           {"irregularSpacing", diagnostics.irregularSpacing}};
 }
 
-// doesn't actually do any length checks, or overflow checks, or anything
-// really.
-template <int N>
-double dotProduct(const std::vector<double> &vec1,
-                  const std::vector<double> &vec2) {
-  double result = 0;
-  for (int i = 0; i < N; i++) {
-    result += vec1.at(i) * vec2.at(i);
+void to_json(json &j, const VolumeGeometry &geometry) {
+  j = json{{"sortedByPosition", geometry.sortedByPosition},
+           {"sliceSpacing", geometry.sliceSpacing},
+           {"diagnostics", geometry.diagnostics},
+           {"size", geometry.size},
+           {"spacing", geometry.spacing},
+           {"origin", geometry.origin},
+           {"direction", geometry.direction}};
+}
+
+// Tags appended to the series UID to distinguish volumes sharing a series,
+// in the same order itk::GDCMSeriesFileNames applies them: the
+// gdcm::SerieHelper defaults followed by our 0008|0021 restriction.
+static const gdcm::Tag SeriesDetailTags[] = {
+    // Series Number
+    gdcm::Tag(0x0020, 0x0011),
+    // Sequence Name
+    gdcm::Tag(0x0018, 0x0024),
+    // Slice Thickness
+    gdcm::Tag(0x0018, 0x0050),
+    // Rows
+    gdcm::Tag(0x0028, 0x0010),
+    // Columns
+    gdcm::Tag(0x0028, 0x0011),
+    // Series Date
+    gdcm::Tag(0x0008, 0x0021),
+};
+
+// Only keep [a-zA-Z0-9.], matching gdcm::SerieHelper's identifiers.
+std::string stripNonAlnum(const std::string &str) {
+  std::string result;
+  result.reserve(str.size());
+  for (char c : str) {
+    if (c == '.' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+        (c >= '0' && c <= '9')) {
+      result += c;
+    }
   }
   return result;
 }
 
-std::vector<double> ReadImageOrientationValue(const std::string &filename) {
+/**
+ * Reads the header of a DICOM file, stopping before the pixel data.
+ *
+ * Returns false if the file cannot be parsed as DICOM.
+ */
+bool ScanDICOMFile(const std::string &filename, DICOMFileRecord &record) {
   gdcm::Reader reader;
   reader.SetFileName(filename.c_str());
-  if (!reader.Read()) {
-    throw std::runtime_error("gdcm: failed to read file");
+  if (!reader.ReadUpToTag(gdcm::Tag(0x7fe0, 0x0010))) {
+    return false;
   }
+
   const gdcm::File &file = reader.GetFile();
-  // This helper method asserts that the vector has length 6.
-  return gdcm::ImageHelper::GetDirectionCosinesValue(file);
-}
+  const gdcm::DataSet &ds = file.GetDataSet();
+
+  gdcm::StringFilter stringFilter;
+  stringFilter.SetFile(file);
 
-bool areCosinesAlmostEqual(std::vector<double> cosines1,
-                           std::vector<double> cosines2,
-                           double epsilon = EPSILON) {
-  for (int i = 0; i <= 1; i++) {
-    std::vector<double> vec1{cosines1.at(i), cosines1.at(i + 1),
-                             cosines1.at(i + 2)};
-    std::vector<double> vec2{cosines2.at(i), cosines2.at(i + 1),
-                             cosines2.at(i + 2)};
-    double dot = dotProduct<3>(vec1, vec2);
-    if (dot < (1 - EPSILON)) {
-      return false;
+  const auto uid = stringFilter.ToString(gdcm::Tag(0x0020, 0x000e));
+  // Mirrors gdcm::SerieHelper::CreateUniqueSeriesIdentifier: the separator is
+  // only added before the first non-empty detail.
+  std::string id = uid;
+  for (const auto &tag : SeriesDetailTags) {
+    const auto value = stringFilter.ToString(tag);
+    if (id == uid && !value.empty()) {
+      id += '.';
     }
+    id += value;
   }
+
+  record.fileName = filename;
+  record.seriesUID = stripNonAlnum(uid);
+  record.seriesID = stripNonAlnum(id);
+  // These helpers assert that the vectors have length 6 and 3.
+  const auto cosines = gdcm::ImageHelper::GetDirectionCosinesValue(file);
+  std::copy_n(cosines.begin(), 6, record.cosines.begin());
+  const auto position = gdcm::ImageHelper::GetOriginValue(file);
+  std::copy_n(position.begin(), 3, record.position.begin());
+  const auto dimensions = gdcm::ImageHelper::GetDimensionsValue(file);
+  std::copy_n(dimensions.begin(), 3, record.dimensions.begin());
+  const auto spacing = gdcm::ImageHelper::GetSpacingValue(file);
+  std::copy_n(spacing.begin(), 3, record.spacing.begin());
+
+  gdcm::Attribute<0x0020, 0x0013> instanceNumber;
+  instanceNumber.SetFromDataSet(ds);
+  record.instanceNumber = instanceNumber.GetValue();
+
   return true;
 }
 
-VolumeMapType SeparateOnImageOrientation(const VolumeMapType &volumeMap) {
-  VolumeMapType newVolumeMap;
-  // Vector< Pair< cosines, volumeID >>
-  std::vector<std::pair<std::vector<double>, std::string>> cosinesToID;
-
-  // append unique ID part to the volume ID, based on cosines
-  // The format replaces non-alphanumeric chars to be semi-consistent with DICOM
-  // UID spec,
-  //   and to make debugging easier when looking at the full volume IDs.
-  // Format: COSINE || "S" || COSINE || "S" || ...
-  //   COSINE: A decimal number -DD.DDDD gets reformatted into NDDSDDDD
-  auto encodeCosinesAsIDPart = [](const std::vector<double> &cosines) {
-    std::string concatenated;
-    for (auto it = cosines.begin(); it != cosines.end(); ++it) {
-      concatenated += std::to_string(*it);
-      if (it != cosines.end() - 1) {
-        concatenated += 'S';
-      }
+/**
+ * Scans every file, skipping the ones that are not readable DICOM.
+ *
+ * Native builds split the header parsing across ITK's multi-threader. Each
+ * file writes into its own slot, and the records are compacted in input
+ * order, so the result does not depend on how the work was scheduled.
+ */
+std::vector<DICOMFileRecord> ScanDICOMFiles(const FileNamesContainer &files,
+                                            unsigned int numberOfThreads = 0,
+                                            uint32_t firstFileIndex = 0) {
+  std::vector<DICOMFileRecord> scanned(files.size());
+  // not vector<bool>, so that threads write to distinct bytes
+  std::vector<char> readable(files.size(), 0);
+
+  auto scanFile = [&](itk::SizeValueType i) {
+    readable[i] = ScanDICOMFile(files[i], scanned[i]);
+  };
+
+#ifdef WEB_BUILD
+  (void)numberOfThreads;
+  for (itk::SizeValueType i = 0; i < files.size(); i++) {
+    scanFile(i);
+  }
+#else
+  auto multiThreader = itk::MultiThreaderBase::New();
+  if (numberOfThreads > 0) {
+    multiThreader->SetMaximumNumberOfThreads(numberOfThreads);
+    multiThreader->SetNumberOfWorkUnits(numberOfThreads);
+  }
+  multiThreader->ParallelizeArray(0, files.size(), scanFile, nullptr);
+#endif
+
+  std::vector<DICOMFileRecord> records;
+  records.reserve(files.size());
+  for (size_t i = 0; i < files.size(); i++) {
+    if (readable[i]) {
+      scanned[i].fileIndex = firstFileIndex + static_cast<uint32_t>(i);
+      records.push_back(std::move(scanned[i]));
     }
+  }
+  return records;
+}
 
-    replaceChars(concatenated, '-', 'N');
-    replaceChars(concatenated, '.', 'D');
+/**
+ * Converts volumes of records to volumes of file names.
+ */
+VolumeMapType ToVolumeMap(const VolumeRecordsMapType &recordsMap) {
+  VolumeMapType volumeMap;
+  for (const auto &[volumeID, volumeRecords] : recordsMap) {
+    auto &fileNames = volumeMap[volumeID];
+    for (const auto *record : volumeRecords) {
+      fileNames.push_back(record->fileName);
+    }
+  }
+  return volumeMap;
+}
 
-    return concatenated;
-  };
+// 'VVM1', little-endian
+static const uint32_t VolumeMapBinaryMagic = 0x314d5656;
 
-  for (const auto &[volumeID, names] : volumeMap) {
-    for (const auto &filename : names) {
-      std::vector<double> curCosines = ReadImageOrientationValue(filename);
-
-      bool inserted = false;
-      for (const auto &entry : cosinesToID) {
-        if (areCosinesAlmostEqual(curCosines, entry.first)) {
-          newVolumeMap[entry.second].push_back(filename);
-          inserted = true;
-          break;
-        }
-      }
+/**
+ * Writes volumes in the compact binary layout read by DICOMIO. Every field is
+ * a uint32 in host order, which is little-endian on all our targets:
+ *
+ *   magic, volumeCount V, fileCount F
+ *   fileOffsets[V + 1]: volume v holds fileIndexes[fileOffsets[v] ..
+ *                       fileOffsets[v + 1])
+ *   idOffsets[V + 1]:   volume v is named ids[idOffsets[v] .. idOffsets[v + 1])
+ *   fileIndexes[F]:     positions of the files in the categorize input
+ *   ids:                the volume IDs as concatenated bytes
+ *
+ * Volumes are written in volume ID order, like the keys of the JSON map.
+ */
+void WriteVolumeMapBinary(std::ostream &stream,
+                          const VolumeRecordsMapType &recordsMap) {
+  const std::map<std::string, RecordList> volumes(recordsMap.begin(),
+                                                  recordsMap.end());
 
-      if (!inserted) {
-        const auto encodedIDPart = encodeCosinesAsIDPart(curCosines);
-        auto newID = volumeID + '.' + encodedIDPart;
-        newVolumeMap[newID].push_back(filename);
-        cosinesToID.push_back(std::make_pair(curCosines, newID));
-      }
+  std::vector<uint32_t> fileOffsets{0};
+  std::vector<uint32_t> idOffsets{0};
+  std::vector<uint32_t> fileIndexes;
+  std::string ids;
+  for (const auto &[volumeID, volumeRecords] : volumes) {
+    for (const auto *record : volumeRecords) {
+      fileIndexes.push_back(record->fileIndex);
     }
+    ids += volumeID;
+    fileOffsets.push_back(static_cast<uint32_t>(fileIndexes.size()));
+    idOffsets.push_back(static_cast<uint32_t>(ids.size()));
   }
 
-  return newVolumeMap;
+  auto writeWords = [&stream](const std::vector<uint32_t> &words) {
+    stream.write(reinterpret_cast<const char *>(words.data()),
+                 words.size() * sizeof(uint32_t));
+  };
+  writeWords({VolumeMapBinaryMagic, static_cast<uint32_t>(volumes.size()),
+              static_cast<uint32_t>(fileIndexes.size())});
+  writeWords(fileOffsets);
+  writeWords(idOffsets);
+  writeWords(fileIndexes);
+  stream.write(ids.data(), ids.size());
 }
 
 /**
@@ -180,6 +307,11 @@ int categorizeFiles(itk::wasm::Pipeline &pipeline) {
       ->check(CLI::ExistingFile)
       ->expected(1, -1);
 
+  unsigned int numberOfThreads = 0;
+  pipeline.add_option("-j,--threads", numberOfThreads,
+                      "Threads used to read headers in native builds (0: ITK "
+                      "default)");
+
   // outputs
   itk::wasm::OutputTextStream volumeMapJSONStream;
   pipeline
@@ -187,63 +319,607 @@ int categorizeFiles(itk::wasm::Pipeline &pipeline) {
                   "JSON object encoding volumeID => filenames.")
       ->required();
 
+  itk::wasm::OutputBinaryStream volumeMapBinaryStream;
+  auto volumeMapBinaryOption = pipeline.add_option(
+      "--volume-map-binary", volumeMapBinaryStream,
+      "Volume map in the binary layout, written instead of the JSON");
+
+  itk::wasm::OutputTextStream volumeGeometryStream;
+  auto volumeGeometryOption = pipeline.add_option(
+      "--volume-geometry", volumeGeometryStream,
+      "JSON object encoding volumeID => slice order and image geometry");
+
   ITK_WASM_PARSE(pipeline);
 
-  std::string path = "./";
+  // The caller wrote exactly these files into the worker, so read them as
+  // given instead of listing the working directory, which may hold files
+  // left behind by earlier calls.
+  VolumeCategorizer categorizer;
+  categorizer.Add(ScanDICOMFiles(files, numberOfThreads));
+  VolumeGeometryMapType geometry;
+  const auto volumes = categorizer.GetVolumes(&geometry);
 
-  // parse out series
-  typedef itk::GDCMSeriesFileNames SeriesFileNames;
-  SeriesFileNames::Pointer seriesFileNames = SeriesFileNames::New();
-  // files are all default dumped to cwd
-  seriesFileNames->SetDirectory(path);
-  seriesFileNames->SetUseSeriesDetails(true);
-  seriesFileNames->SetGlobalWarningDisplay(false);
-  seriesFileNames->AddSeriesRestriction("0008|0021");
-  seriesFileNames->SetRecursive(false);
-  // Does this affect series organization?
-  seriesFileNames->SetLoadPrivateTags(false);
+  if (!volumeMapBinaryOption->empty()) {
+    WriteVolumeMapBinary(volumeMapBinaryStream.Get(), volumes);
+  } else {
+    // Generate the JSON and add to output stream
+    auto volumeMapJSON = json(ToVolumeMap(volumes));
+    volumeMapJSONStream.Get() << volumeMapJSON;
+  }
 
-  // Obtain the initial separation of imported files into distinct volumes.
-  auto &gdcmSeriesUIDs = seriesFileNames->GetSeriesUIDs();
+  if (!volumeGeometryOption->empty()) {
+    volumeGeometryStream.Get() << json(geometry);
+  }
 
-  // The initial series UIDs are used as the basis for our volume IDs.
-  VolumeMapType volumeMap;
-  for (auto seriesUID : gdcmSeriesUIDs) {
-    volumeMap[seriesUID] = seriesFileNames->GetFileNames(seriesUID.c_str());
+  // Clean up files
+  for (auto &file : files) {
+    remove(file.c_str());
   }
 
-  // further restrict on orientation
-  volumeMap = SeparateOnImageOrientation(volumeMap);
+  return EXIT_SUCCESS;
+}
+
+// sessionID -> categorization fed by categorizeBatch. Lives as long as the
+// worker running this module.
+struct CategorizeSession {
+  VolumeCategorizer categorizer;
+  // files received so far, DICOM or not
+  uint32_t fileCount = 0;
+};
+static std::unordered_map<std::string, CategorizeSession> categorizeSessions;
+
+/**
+ * categorizeBatch categorizes a large set of DICOM files in batches.
+ *
+ * Each call adds a batch of files to the categorization identified by
+ * --session and returns the volumes that batch contributed to, listing only
+ * the batch's files. Headers are read and files removed as each batch comes
+ * in, so memory use is bounded by the batch size and not the whole set.
+ *
+ * A final call with --finish returns the complete volume map, with the files
+ * of each volume ordered as with categorize, and ends the session. Only that
+ * call has volume geometry to write; earlier ones write an empty object. A
+ * call that fails also ends the session.
+ */
+int categorizeBatch(itk::wasm::Pipeline &pipeline) {
+
+  // inputs
+  FileNamesContainer files;
+  pipeline.add_option("-f,--files", files, "File names to categorize")
+      ->check(CLI::ExistingFile)
+      ->expected(0, -1);
+
+  std::string sessionID;
+  pipeline
+      .add_option("--session", sessionID,
+                  "Categorization the batch belongs to")
+      ->required();
+
+  bool finish = false;
+  pipeline.add_flag("--finish", finish,
+                    "Output the complete volume map and end the session");
+
+  unsigned int numberOfThreads = 0;
+  pipeline.add_option("-j,--threads", numberOfThreads,
+                      "Threads used to read headers in native builds (0: ITK "
+                      "default)");
+
+  // outputs
+  itk::wasm::OutputTextStream volumeMapJSONStream;
+  pipeline
+      .add_option("volumeMap", volumeMapJSONStream,
+                  "JSON object encoding volumeID => filenames.")
+      ->required();
 
-  // strip off tmp prefix
-  for (auto &entry : volumeMap) {
-    auto &fileNames = entry.second;
-    for (auto &f : fileNames) {
-      f = f.substr(path.size());
+  itk::wasm::OutputBinaryStream volumeMapBinaryStream;
+  auto volumeMapBinaryOption = pipeline.add_option(
+      "--volume-map-binary", volumeMapBinaryStream,
+      "Volume map in the binary layout, written instead of the JSON");
+
+  itk::wasm::OutputTextStream volumeGeometryStream;
+  auto volumeGeometryOption = pipeline.add_option(
+      "--volume-geometry", volumeGeometryStream,
+      "JSON object encoding volumeID => slice order and image geometry");
+
+  ITK_WASM_PARSE(pipeline);
+
+  auto &session = categorizeSessions[sessionID];
+  try {
+    auto volumes = session.categorizer.Add(
+        ScanDICOMFiles(files, numberOfThreads, session.fileCount));
+    session.fileCount += static_cast<uint32_t>(files.size());
+
+    // Clean up files
+    for (auto &file : files) {
+      remove(file.c_str());
+    }
+
+    VolumeGeometryMapType geometry;
+    if (finish) {
+      volumes = session.categorizer.GetVolumes(&geometry);
     }
+
+    if (!volumeMapBinaryOption->empty()) {
+      WriteVolumeMapBinary(volumeMapBinaryStream.Get(), volumes);
+    } else {
+      volumeMapJSONStream.Get() << json(ToVolumeMap(volumes));
+    }
+
+    if (!volumeGeometryOption->empty()) {
+      volumeGeometryStream.Get() << json(geometry);
+    }
+  } catch (...) {
+    // a failed batch ends its session, which would otherwise keep its
+    // records for the life of the module
+    categorizeSessions.erase(sessionID);
+    throw;
   }
 
-  // Generate the JSON and add to output stream
-  auto volumeMapJSON = json(volumeMap);
-  volumeMapJSONStream.Get() << volumeMapJSON;
+  // records are owned by the session, so only drop it once written out
+  if (finish) {
+    categorizeSessions.erase(sessionID);
+  }
 
-  // Clean up files
-  for (auto &file : files) {
-    remove(file.c_str());
+  return EXIT_SUCCESS;
+}
+
+using ThumbnailImageType = itk::Image<uint8_t, 3>;
+
+/**
+ * How a slice is first displayed, from its header.
+ */
+struct SliceDisplay {
+  // 0028|1050 Window Center and 0028|1051 Window Width, if both are set
+  bool hasWindow = false;
+  double windowCenter = 0;
+  double windowWidth = 0;
+  // MONOCHROME1 displays the lowest values as white
+  bool inverted = false;
+};
+
+// Parses the first value of a numeric tag held as a backslash separated
+// string, like GDCMImageIO and gdcm::StringFilter return them.
+bool ParseFirstTagValue(const std::string &str, double &value) {
+  try {
+    value = std::stod(str.substr(0, str.find('\\')));
+  } catch (const std::exception &) {
+    return false;
   }
+  return true;
+}
+
+SliceDisplay ParseSliceDisplay(const std::string &windowCenter,
+                               const std::string &windowWidth,
+                               const std::string &photometric) {
+  SliceDisplay display;
+  display.hasWindow = ParseFirstTagValue(windowCenter, display.windowCenter) &&
+                      ParseFirstTagValue(windowWidth, display.windowWidth) &&
+                      display.windowWidth > 1;
+  display.inverted = photometric.find("MONOCHROME1") != std::string::npos;
+  return display;
+}
+
+// Intensity of a pixel with samples in the given type, like ITK converts
+// RGB pixels to scalars.
+template <typename T>
+void FrameToIntensities(const char *buffer, size_t pixelCount,
+                        unsigned int samples, bool planar, double slope,
+                        double intercept, float *intensities) {
+  const T *values = reinterpret_cast<const T *>(buffer);
+  if (samples == 1) {
+    for (size_t i = 0; i < pixelCount; i++) {
+      intensities[i] = static_cast<float>(values[i] * slope + intercept);
+    }
+    return;
+  }
+  const size_t pixelStride = planar ? 1 : samples;
+  const size_t sampleStride = planar ? pixelCount : 1;
+  for (size_t i = 0; i < pixelCount; i++) {
+    const T *pixel = values + i * pixelStride;
+    intensities[i] = static_cast<float>(0.2125 * pixel[0] +
+                                        0.7154 * pixel[sampleStride] +
+                                        0.0721 * pixel[2 * sampleStride]);
+  }
+}
+
+/**
+ * Decodes a single frame of a DICOM file as a one-slice float image.
+ *
+ * gdcm::ImageRegionReader only decodes the requested frame, seeking to its
+ * fragment in encapsulated transfer syntaxes, so a frame of a long cine
+ * costs about as much as a single-frame file. Rescale Slope and Intercept
+ * are applied like GDCMImageIO does.
+ */
+ImageType::Pointer ReadDICOMFrame(const std::string &fileName,
+                                  unsigned int frame, SliceDisplay &display) {
+  gdcm::ImageRegionReader reader;
+  reader.SetFileName(fileName.c_str());
+  if (!reader.ReadInformation()) {
+    throw std::runtime_error("Cannot read the DICOM header of " + fileName);
+  }
+
+  const gdcm::File &file = reader.GetFile();
+  const auto dimensions = gdcm::ImageHelper::GetDimensionsValue(file);
+  if (frame >= std::max(dimensions[2], 1u)) {
+    throw std::runtime_error("Frame " + std::to_string(frame) +
+                             " is out of bounds in " + fileName);
+  }
+
+  gdcm::BoxRegion box;
+  box.SetDomain(0, dimensions[0] - 1, 0, dimensions[1] - 1, frame, frame);
+  reader.SetRegion(box);
+  std::vector<char> buffer(reader.ComputeBufferLength());
+  if (!reader.ReadIntoBuffer(buffer.data(), buffer.size())) {
+    throw std::runtime_error("Cannot decode frame " + std::to_string(frame) +
+                             " of " + fileName);
+  }
+
+  gdcm::StringFilter stringFilter;
+  stringFilter.SetFile(file);
+  display = ParseSliceDisplay(stringFilter.ToString(gdcm::Tag(0x0028, 0x1050)),
+                              stringFilter.ToString(gdcm::Tag(0x0028, 0x1051)),
+                              stringFilter.ToString(gdcm::Tag(0x0028, 0x0004)));
+
+  // Geometry of the frame, assuming evenly spaced frames like GDCMImageIO
+  const auto cosines = gdcm::ImageHelper::GetDirectionCosinesValue(file);
+  const auto origin = gdcm::ImageHelper::GetOriginValue(file);
+  const auto spacing = gdcm::ImageHelper::GetSpacingValue(file);
+  Cosines frameCosines;
+  std::copy_n(cosines.begin(), 6, frameCosines.begin());
+  const auto normal = sliceNormal(frameCosines);
+
+  auto image = ImageType::New();
+  ImageType::RegionType region;
+  region.SetSize(0, dimensions[0]);
+  region.SetSize(1, dimensions[1]);
+  region.SetSize(2, 1);
+  image->SetRegions(region);
+  ImageType::SpacingType imageSpacing;
+  ImageType::PointType imageOrigin;
+  ImageType::DirectionType direction;
+  for (unsigned int row = 0; row < 3; row++) {
+    imageSpacing[row] = spacing[row];
+    imageOrigin[row] = origin[row] + frame * spacing[2] * normal[row];
+    direction[row][0] = cosines[row];
+    direction[row][1] = cosines[3 + row];
+    direction[row][2] = normal[row];
+  }
+  image->SetSpacing(imageSpacing);
+  image->SetOrigin(imageOrigin);
+  image->SetDirection(direction);
+  image->Allocate();
+
+  const gdcm::Image &gdcmImage = reader.GetImage();
+  const auto &pixelFormat = gdcmImage.GetPixelFormat();
+  const unsigned int samples = pixelFormat.GetSamplesPerPixel();
+  const bool planar = gdcmImage.GetPlanarConfiguration() == 1;
+  const auto interceptSlope =
+      gdcm::ImageHelper::GetRescaleInterceptSlopeValue(file);
+  const size_t pixelCount = static_cast<size_t>(dimensions[0]) * dimensions[1];
+  float *intensities = image->GetBufferPointer();
+
+#define FRAME_TO_INTENSITIES(scalarType, T)                                    \
+  case gdcm::PixelFormat::scalarType:                                          \
+    FrameToIntensities<T>(buffer.data(), pixelCount, samples, planar,          \
+                          interceptSlope[1], interceptSlope[0], intensities);  \
+    break;
+
+  switch (pixelFormat.GetScalarType()) {
+    FRAME_TO_INTENSITIES(UINT8, uint8_t)
+    FRAME_TO_INTENSITIES(INT8, int8_t)
+    FRAME_TO_INTENSITIES(UINT16, uint16_t)
+    FRAME_TO_INTENSITIES(INT16, int16_t)
+    FRAME_TO_INTENSITIES(UINT32, uint32_t)
+    FRAME_TO_INTENSITIES(INT32, int32_t)
+    FRAME_TO_INTENSITIES(FLOAT32, float)
+    FRAME_TO_INTENSITIES(FLOAT64, double)
+  default:
+    throw std::runtime_error("Unsupported pixel format in " + fileName);
+  }
+
+#undef FRAME_TO_INTENSITIES
+
+  return image;
+}
+
+/**
+ * Reads slices as uint8 thumbnails.
+ *
+ * Slices with a Window Center and Width are mapped through that window,
+ * like a viewer would first display them. Others are rescaled between
+ * their minimum and maximum. GDCMImageIO already applies the Rescale Slope
+ * and Intercept, so the pixels and the window are both in modality units.
+ *
+ * Slices are read in the component type GDCMImageIO reports for them, as in
+ * getSliceImage, so a 16-bit slice is never widened to float. Either mapping
+ * is then a single fused pass from the shrunk native slice straight to uint8
+ * (see uint8_kernels.hpp), after a min/max pass for the latter. Color slices
+ * and decoded frames are float intensities.
+ *
+ * One ImageIO is set up and then reused for every file, by only changing the
+ * file name between calls.
+ */
+class ThumbnailGenerator {
+public:
+  /**
+   * thumbnailSize is the longest thumbnail edge in pixels, 0 to keep the full
+   * resolution.
+   */
+  explicit ThumbnailGenerator(unsigned int thumbnailSize)
+      : m_ThumbnailSize(thumbnailSize) {
+    m_DicomIO->LoadPrivateTagsOff();
+  }
+
+  /**
+   * Returns the thumbnail of a file, or of one of its frames if frame is not
+   * negative. With firstFrameOnly, a negative frame of a multi-frame file
+   * only decodes its first frame, for callers that only keep that one. The
+   * generator releases the image on the next call.
+   */
+  ThumbnailImageType *Generate(const std::string &fileName, int frame = -1,
+                               bool firstFrameOnly = false) {
+    SliceDisplay display;
+    if (frame >= 0) {
+      ImageType::Pointer frameImage = ReadDICOMFrame(fileName, frame, display);
+      ShrinkAndMap(frameImage.GetPointer(), display);
+      return m_Thumbnail;
+    }
+
+    m_DicomIO->SetFileName(fileName);
+    m_DicomIO->ReadImageInformation();
+    if (firstFrameOnly && m_DicomIO->GetNumberOfDimensions() > 2 &&
+        m_DicomIO->GetDimensions(2) > 1) {
+      return Generate(fileName, 0);
+    }
+
+    const auto &dictionary = m_DicomIO->GetMetaDataDictionary();
+    std::string windowCenter;
+    std::string windowWidth;
+    std::string photometric;
+    itk::ExposeMetaData<std::string>(dictionary, "0028|1050", windowCenter);
+    itk::ExposeMetaData<std::string>(dictionary, "0028|1051", windowWidth);
+    itk::ExposeMetaData<std::string>(dictionary, "0028|0004", photometric);
+    display = ParseSliceDisplay(windowCenter, windowWidth, photometric);
+
+    const auto componentType =
+        m_DicomIO->GetPixelType() == itk::IOPixelEnum::SCALAR
+            ? m_DicomIO->GetComponentType()
+            : itk::IOComponentEnum::FLOAT;
+    switch (componentType) {
+    case itk::IOComponentEnum::UCHAR:
+      ReadShrinkAndMap<uint8_t>(fileName, display);
+      break;
+    case itk::IOComponentEnum::CHAR:
+      ReadShrinkAndMap<int8_t>(fileName, display);
+      break;
+    case itk::IOComponentEnum::USHORT:
+      ReadShrinkAndMap<uint16_t>(fileName, display);
+      break;
+    case itk::IOComponentEnum::SHORT:
+      ReadShrinkAndMap<int16_t>(fileName, display);
+      break;
+    case itk::IOComponentEnum::UINT:
+      ReadShrinkAndMap<uint32_t>(fileName, display);
+      break;
+    case itk::IOComponentEnum::INT:
+      ReadShrinkAndMap<int32_t>(fileName, display);
+      break;
+    case itk::IOComponentEnum::DOUBLE:
+      ReadShrinkAndMap<double>(fileName, display);
+      break;
+    default:
+      ReadShrinkAndMap<float>(fileName, display);
+      break;
+    }
+    return m_Thumbnail;
+  }
+
+private:
+  template <typename TPixel>
+  void ReadShrinkAndMap(const std::string &fileName,
+                        const SliceDisplay &display) {
+    using NativeImageType = itk::Image<TPixel, 3>;
+    using NativeReaderType = itk::ImageFileReader<NativeImageType>;
+
+    typename NativeReaderType::Pointer reader = NativeReaderType::New();
+    reader->SetImageIO(m_DicomIO);
+    reader->SetFileName(fileName);
+    reader->UpdateOutputInformation();
+    ShrinkAndMap(reader->GetOutput(), display);
+  }
+
+  template <typename TPixel>
+  void ShrinkAndMap(const itk::Image<TPixel, 3> *slice,
+                    const SliceDisplay &display) {
+    using NativeImageType = itk::Image<TPixel, 3>;
+    using ShrinkFilter =
+        itk::BinShrinkImageFilter<NativeImageType, NativeImageType>;
+
+    // Average the slice down in-plane before anything else touches its
+    // pixels, with the same factor on both axes to keep the aspect ratio.
+    const auto size = slice->GetLargestPossibleRegion().GetSize();
+    unsigned int shrinkFactor = 1;
+    if (m_ThumbnailSize > 0) {
+      const auto longestEdge = std::max(size[0], size[1]);
+      shrinkFactor = static_cast<unsigned int>(
+          (longestEdge + m_ThumbnailSize - 1) / m_ThumbnailSize);
+    }
+    typename ShrinkFilter::Pointer shrinkFilter = ShrinkFilter::New();
+    shrinkFilter->SetInput(slice);
+    shrinkFilter->SetShrinkFactor(0, shrinkFactor);
+    shrinkFilter->SetShrinkFactor(1, shrinkFactor);
+    shrinkFilter->SetShrinkFactor(2, 1);
+
+    shrinkFilter->UpdateLargestPossibleRegion();
+    const NativeImageType *shrunk = shrinkFilter->GetOutput();
+    const size_t pixelCount =
+        shrunk->GetLargestPossibleRegion().GetNumberOfPixels();
+
+    Uint8Mapping mapping;
+    if (display.hasWindow) {
+      // Linear VOI LUT function of DICOM PS3.3 C.11.2.1.2.1: a single
+      // clamped linear map, with no pass over the pixels to find a range.
+      const double center = display.windowCenter;
+      const double width = display.windowWidth;
+      mapping = uint8Mapping(center - 0.5 - (width - 1) / 2,
+                             center - 0.5 + (width - 1) / 2, display.inverted);
+    } else {
+      double minimum;
+      double maximum;
+      minMaxIntensity(shrunk->GetBufferPointer(), pixelCount, minimum,
+                      maximum);
+      mapping = uint8Mapping(minimum, maximum, display.inverted);
+    }
+
+    m_Thumbnail = ThumbnailImageType::New();
+    m_Thumbnail->CopyInformation(shrunk);
+    m_Thumbnail->SetRegions(shrunk->GetLargestPossibleRegion());
+    m_Thumbnail->Allocate();
+    mapToUint8(shrunk->GetBufferPointer(), pixelCount, mapping,
+               m_Thumbnail->GetBufferPointer());
+  }
+
+  unsigned int m_ThumbnailSize;
+  DicomIO::Pointer m_DicomIO = DicomIO::New();
+  ThumbnailImageType::Pointer m_Thumbnail;
+};
+
+/**
+ * Encodes the first slice of a thumbnail as PNG or JPEG, ready to be
+ * displayed as is. The image IOs only write files, so the encoding goes
+ * through a temporary file, named uniquely so calls cannot collide.
+ */
+std::string EncodeThumbnail(const ThumbnailImageType *thumbnail,
+                            const std::string &encoding, int quality) {
+  itk::ImageIOBase::Pointer imageIO;
+  if (encoding == "jpeg") {
+    auto jpegIO = itk::JPEGImageIO::New();
+    jpegIO->SetQuality(quality);
+    imageIO = jpegIO;
+  } else {
+    imageIO = itk::PNGImageIO::New();
+  }
+
+  const auto size = thumbnail->GetLargestPossibleRegion().GetSize();
+  imageIO->SetNumberOfDimensions(2);
+  imageIO->SetDimensions(0, size[0]);
+  imageIO->SetDimensions(1, size[1]);
+  imageIO->SetPixelType(itk::IOPixelEnum::SCALAR);
+  imageIO->SetComponentType(itk::IOComponentEnum::UCHAR);
+  imageIO->SetNumberOfComponents(1);
+
+  static std::atomic<unsigned int> encodedCount{0};
+  const std::string fileName =
+      "thumbnail-" + std::to_string(encodedCount++) + "." + encoding;
+  imageIO->SetFileName(fileName);
+  try {
+    imageIO->Write(thumbnail->GetBufferPointer());
+  } catch (...) {
+    remove(fileName.c_str());
+    throw;
+  }
+
+  std::ifstream file(fileName, std::ios::binary);
+  const std::string encoded((std::istreambuf_iterator<char>(file)),
+                            std::istreambuf_iterator<char>());
+  file.close();
+  remove(fileName.c_str());
+  return encoded;
+}
+
+/**
+ * A decoded slice kept in sliceCache.
+ */
+struct CachedSlice {
+  CachedSlice() = default;
+  explicit CachedSlice(itk::DataObject::Pointer slice)
+      : image(std::move(slice)) {}
+
+  itk::DataObject::Pointer image;
+  // component type and --slice-info of full slices
+  itk::IOComponentEnum componentType =
+      itk::IOComponentEnum::UNKNOWNCOMPONENTTYPE;
+  json sliceInfo;
+};
+
+// Exit status of getSliceImage when the slice asked for without --file is not
+// in sliceCache, so the caller knows to send the file. Not an exception, as
+// misses are expected and the module outlives them.
+static const int SliceCacheMissExitCode = 2;
+
+// Default byte budget of sliceCache, in MiB.
+static const size_t SliceCacheDefaultBudget = 256;
+
+// Decoded slices by file identity and read options. Lives as long as the
+// worker running this module, so a slice requested again skips both the file
+// copy and GDCM.
+static LRUCache<CachedSlice> sliceCache(SliceCacheDefaultBudget * 1024 *
+                                        1024);
+
+/**
+ * Outputs a slice in the pixel type GDCMImageIO produces for it, so the pixels
+ * are not converted on the way out.
+ *
+ * The slice is read unless image already holds it, and is then returned in
+ * image along with its size in bytes.
+ */
+template <typename TPixel>
+int OutputNativeSlice(itk::wasm::Pipeline &pipeline,
+                      const std::string &fileName, DicomIO *dicomIO,
+                      itk::DataObject::Pointer &image, size_t &bytes) {
+  using NativeImageType = itk::Image<TPixel, 3>;
+  using NativeReaderType = itk::ImageFileReader<NativeImageType>;
+
+  // outputs
+  using WasmOutputImageType = itk::wasm::OutputImage<NativeImageType>;
+  WasmOutputImageType outputImage;
+  pipeline.add_option("OutputImage", outputImage, "The slice")->required();
+
+  ITK_WASM_PARSE(pipeline);
+
+  typename NativeImageType::Pointer slice =
+      static_cast<NativeImageType *>(image.GetPointer());
+  if (!slice) {
+    typename NativeReaderType::Pointer reader = NativeReaderType::New();
+    reader->SetImageIO(dicomIO);
+    reader->SetFileName(fileName);
+    reader->Update();
+    slice = reader->GetOutput();
+    slice->DisconnectPipeline();
+    image = slice;
+  }
+  bytes = slice->GetLargestPossibleRegion().GetNumberOfPixels() *
+          sizeof(TPixel);
+  outputImage.Set(slice);
 
   return EXIT_SUCCESS;
 }
 
 /**
  * Reads an image slice and returns the optionally thumbnailed image.
+ *
+ * Full slices keep the component type GDCMImageIO reads them as: the stored
+ * type, or the smallest type holding the values once Rescale Slope and
+ * Intercept are applied. The applied rescale is reported in --slice-info.
+ * Color slices are still read as float intensities.
+ *
+ * With --frame, only that frame is decoded and returned as a one-slice float
+ * image, with the rescale applied.
+ *
+ * With --encoding, the thumbnail is returned as a PNG or JPEG byte stream
+ * instead of an image.
+ *
+ * With --cache-key, the decoded slice is kept in sliceCache under that key and
+ * the read options. A later call with the same key and options may then leave
+ * out --file: the slice comes from the cache, or the call exits with
+ * SliceCacheMissExitCode and no outputs if it was evicted, and the caller has
+ * to send the file again.
  */
 int getSliceImage(itk::wasm::Pipeline &pipeline) {
 
   // inputs
   std::string fileName;
   pipeline.add_option("-f,--file", fileName, "File name generate image for")
-      ->required()
       ->check(CLI::ExistingFile)
       ->expected(1);
 
@@ -251,42 +927,99 @@ int getSliceImage(itk::wasm::Pipeline &pipeline) {
   pipeline.add_option("-t,--thumbnail", asThumbnail,
                       "Generate thumbnail image");
 
+  unsigned int thumbnailSize = 0;
+  pipeline.add_option("-s,--thumbnail-size", thumbnailSize,
+                      "Longest thumbnail edge in pixels (0: full resolution)");
+
+  int frame = -1;
+  pipeline.add_option("--frame", frame,
+                      "Only decode this frame of a multi-frame file (-1: all "
+                      "frames)");
+
+  std::string encoding;
+  pipeline
+      .add_option("--encoding", encoding,
+                  "Return the thumbnail encoded in this format")
+      ->check(CLI::IsMember({"png", "jpeg"}));
+
+  int quality = 90;
+  pipeline.add_option("--quality", quality, "JPEG quality, from 1 to 100")
+      ->check(CLI::Range(1, 100));
+
+  std::string cacheKey;
+  pipeline.add_option("--cache-key", cacheKey,
+                      "Identity of the file, to cache the decoded slice under");
+
+  size_t cacheBudget = SliceCacheDefaultBudget;
+  auto cacheBudgetOption = pipeline.add_option(
+      "--cache-budget", cacheBudget, "Size of the slice cache in MiB");
+
   ITK_WASM_PRE_PARSE(pipeline);
 
-  // Setup reader
-  typename DicomIO::Pointer dicomIO = DicomIO::New();
-  dicomIO->LoadPrivateTagsOff();
-  typename ReaderType::Pointer reader = ReaderType::New();
-  reader->SetFileName(fileName);
+  // outputs
+  itk::wasm::OutputTextStream cacheStatsStream;
+  auto cacheStatsOption = pipeline.add_option(
+      "--cache-stats", cacheStatsStream,
+      "JSON object with the slice cache hit and miss counts");
 
-  if (asThumbnail) {
-    using InputImageType = ImageType;
-    using OutputPixelType = uint8_t;
-    using OutputImageType = itk::Image<OutputPixelType, 3>;
-    using RescaleFilter =
-        itk::RescaleIntensityImageFilter<InputImageType, InputImageType>;
-    using CastImageFilter =
-        itk::CastImageFilter<InputImageType, OutputImageType>;
+  if (!encoding.empty() && !asThumbnail) {
+    throw std::runtime_error("--encoding only applies to thumbnails");
+  }
 
+  if (!cacheBudgetOption->empty()) {
+    sliceCache.SetBudget(cacheBudget * 1024 * 1024);
+  }
+
+  std::string sliceKey;
+  const CachedSlice *cached = nullptr;
+  if (!cacheKey.empty()) {
+    // encoded thumbnails only keep the first frame
+    sliceKey = cacheKey + '|' + std::to_string(asThumbnail) + '|' +
+               std::to_string(thumbnailSize) + '|' + std::to_string(frame) +
+               '|' + std::to_string(!encoding.empty());
+    cached = sliceCache.Get(sliceKey);
+  }
+  if (!cached && fileName.empty()) {
+    return SliceCacheMissExitCode;
+  }
+  const bool hit = cached != nullptr;
+
+  if (asThumbnail) {
     // outputs
-    using WasmOutputImageType = itk::wasm::OutputImage<OutputImageType>;
+    using WasmOutputImageType = itk::wasm::OutputImage<ThumbnailImageType>;
     WasmOutputImageType outputImage;
-    pipeline.add_option("OutputImage", outputImage, "The slice")->required();
+    itk::wasm::OutputBinaryStream encodedStream;
+    if (encoding.empty()) {
+      pipeline.add_option("OutputImage", outputImage, "The slice")->required();
+    } else {
+      pipeline.add_option("OutputImage", encodedStream, "The encoded slice")
+          ->required();
+    }
 
     ITK_WASM_PARSE(pipeline);
 
-    auto rescaleFilter = RescaleFilter::New();
-    rescaleFilter->SetInput(reader->GetOutput());
-    rescaleFilter->SetOutputMinimum(0);
-    rescaleFilter->SetOutputMaximum(itk::NumericTraits<OutputPixelType>::max());
-
-    auto castFilter = CastImageFilter::New();
-    castFilter->SetInput(rescaleFilter->GetOutput());
-    castFilter->Update();
+    ThumbnailImageType::Pointer thumbnail;
+    if (cached) {
+      thumbnail = static_cast<ThumbnailImageType *>(cached->image.GetPointer());
+    } else {
+      ThumbnailGenerator generator(thumbnailSize);
+      thumbnail = generator.Generate(fileName, frame, !encoding.empty());
+      thumbnail->DisconnectPipeline();
+      if (!sliceKey.empty()) {
+        const size_t bytes =
+            thumbnail->GetLargestPossibleRegion().GetNumberOfPixels();
+        sliceCache.Put(sliceKey, CachedSlice(thumbnail.GetPointer()), bytes);
+      }
+    }
 
     // Set the output image
-    outputImage.Set(castFilter->GetOutput());
-  } else {
+    if (encoding.empty()) {
+      outputImage.Set(thumbnail);
+    } else {
+      const auto encoded = EncodeThumbnail(thumbnail, encoding, quality);
+      encodedStream.Get().write(encoded.data(), encoded.size());
+    }
+  } else if (frame >= 0) {
     // outputs
     using WasmOutputImageType = itk::wasm::OutputImage<ImageType>;
     WasmOutputImageType outputImage;
@@ -294,12 +1027,610 @@ int getSliceImage(itk::wasm::Pipeline &pipeline) {
 
     ITK_WASM_PARSE(pipeline);
 
-    reader->Update();
-    outputImage.Set(reader->GetOutput());
+    ImageType::Pointer frameImage;
+    if (cached) {
+      frameImage = static_cast<ImageType *>(cached->image.GetPointer());
+    } else {
+      SliceDisplay display;
+      frameImage = ReadDICOMFrame(fileName, frame, display);
+      if (!sliceKey.empty()) {
+        const size_t bytes =
+            frameImage->GetLargestPossibleRegion().GetNumberOfPixels() *
+            sizeof(ImageType::PixelType);
+        sliceCache.Put(sliceKey, CachedSlice(frameImage.GetPointer()), bytes);
+      }
+    }
+    outputImage.Set(frameImage);
+  } else {
+    // outputs
+    itk::wasm::OutputTextStream sliceInfoStream;
+    auto sliceInfoOption = pipeline.add_option(
+        "--slice-info", sliceInfoStream,
+        "JSON object with the pixel types and the rescale applied to the "
+        "pixels");
+
+    typename DicomIO::Pointer dicomIO = DicomIO::New();
+    CachedSlice slice;
+    if (cached) {
+      slice = *cached;
+    } else {
+      dicomIO->LoadPrivateTagsOff();
+      dicomIO->SetFileName(fileName);
+      dicomIO->ReadImageInformation();
+
+      slice.componentType =
+          dicomIO->GetPixelType() == itk::IOPixelEnum::SCALAR
+              ? dicomIO->GetComponentType()
+              : itk::IOComponentEnum::FLOAT;
+      slice.sliceInfo = json{
+          {"componentType",
+           DicomIO::GetComponentTypeAsString(slice.componentType)},
+          {"storedComponentType", DicomIO::GetComponentTypeAsString(
+                                      dicomIO->GetInternalComponentType())},
+          // already applied to the pixels
+          {"rescaleSlope", dicomIO->GetRescaleSlope()},
+          {"rescaleIntercept", dicomIO->GetRescaleIntercept()},
+      };
+    }
+
+    size_t bytes = 0;
+    int result = EXIT_SUCCESS;
+    switch (slice.componentType) {
+    case itk::IOComponentEnum::UCHAR:
+      result = OutputNativeSlice<uint8_t>(pipeline, fileName, dicomIO,
+                                          slice.image, bytes);
+      break;
+    case itk::IOComponentEnum::CHAR:
+      result = OutputNativeSlice<int8_t>(pipeline, fileName, dicomIO,
+                                         slice.image, bytes);
+      break;
+    case itk::IOComponentEnum::USHORT:
+      result = OutputNativeSlice<uint16_t>(pipeline, fileName, dicomIO,
+                                           slice.image, bytes);
+      break;
+    case itk::IOComponentEnum::SHORT:
+      result = OutputNativeSlice<int16_t>(pipeline, fileName, dicomIO,
+                                          slice.image, bytes);
+      break;
+    case itk::IOComponentEnum::UINT:
+      result = OutputNativeSlice<uint32_t>(pipeline, fileName, dicomIO,
+                                           slice.image, bytes);
+      break;
+    case itk::IOComponentEnum::INT:
+      result = OutputNativeSlice<int32_t>(pipeline, fileName, dicomIO,
+                                          slice.image, bytes);
+      break;
+    case itk::IOComponentEnum::DOUBLE:
+      result = OutputNativeSlice<double>(pipeline, fileName, dicomIO,
+                                         slice.image, bytes);
+      break;
+    default:
+      result = OutputNativeSlice<float>(pipeline, fileName, dicomIO,
+                                        slice.image, bytes);
+      break;
+    }
+    if (result != EXIT_SUCCESS) {
+      return result;
+    }
+
+    if (!sliceInfoOption->empty()) {
+      sliceInfoStream.Get() << slice.sliceInfo;
+    }
+    if (!cached && !sliceKey.empty()) {
+      sliceCache.Put(sliceKey, std::move(slice), bytes);
+    }
+  }
+
+  if (!cacheStatsOption->empty()) {
+    cacheStatsStream.Get() << json{
+        {"hit", hit},
+        {"hits", sliceCache.Hits()},
+        {"misses", sliceCache.Misses()},
+        {"entries", sliceCache.Size()},
+        {"bytes", sliceCache.Bytes()},
+        {"budget", sliceCache.Budget()},
+    };
   }
 
   // Clean up the file
-  remove(fileName.c_str());
+  if (!fileName.empty()) {
+    remove(fileName.c_str());
+  }
+
+  return EXIT_SUCCESS;
+}
+
+// 'VTE1', little-endian
+static const uint32_t EncodedThumbnailsBinaryMagic = 0x31455456;
+
+/**
+ * getThumbnails reads the thumbnails of many slices in a single call.
+ *
+ * Each thumbnail is encoded as a PNG or JPEG file, and all of them are
+ * written to one binary stream of uint32 fields in host order followed by
+ * bytes:
+ *
+ *   magic 'VTE1', count N
+ *   lengths[N]: byte length of each file, 0 if the file could not be read
+ *   files:      the encoded thumbnails in turn. Only the first frame of
+ *               multi-frame files is kept, unless --frames selects another.
+ */
+int getThumbnails(itk::wasm::Pipeline &pipeline) {
+
+  // inputs
+  FileNamesContainer files;
+  pipeline.add_option("-f,--files", files, "File names to generate images for")
+      ->required()
+      ->check(CLI::ExistingFile)
+      ->expected(1, -1);
+
+  unsigned int thumbnailSize = 0;
+  pipeline.add_option("-s,--thumbnail-size", thumbnailSize,
+                      "Longest thumbnail edge in pixels (0: full resolution)");
+
+  std::vector<int> frames;
+  pipeline
+      .add_option("--frames", frames,
+                  "Frame to decode for each file (-1: all frames)")
+      ->expected(0, -1);
+
+  std::string encoding = "png";
+  pipeline
+      .add_option("--encoding", encoding,
+                  "Format to encode the thumbnails in")
+      ->check(CLI::IsMember({"png", "jpeg"}));
+
+  int quality = 90;
+  pipeline.add_option("--quality", quality, "JPEG quality, from 1 to 100")
+      ->check(CLI::Range(1, 100));
+
+  // outputs
+  itk::wasm::OutputBinaryStream thumbnailsStream;
+  pipeline
+      .add_option("thumbnails", thumbnailsStream,
+                  "The thumbnails of the files, in order")
+      ->required();
+
+  ITK_WASM_PARSE(pipeline);
+
+  if (!frames.empty() && frames.size() != files.size()) {
+    throw std::runtime_error("--frames needs one frame per file");
+  }
+
+  ThumbnailGenerator generator(thumbnailSize);
+
+  std::vector<uint32_t> header{EncodedThumbnailsBinaryMagic,
+                               static_cast<uint32_t>(files.size())};
+  std::string encodedFiles;
+  for (size_t i = 0; i < files.size(); i++) {
+    std::string encoded;
+    try {
+      const auto *thumbnail = generator.Generate(
+          files[i], frames.empty() ? -1 : frames[i], true);
+      encoded = EncodeThumbnail(thumbnail, encoding, quality);
+    } catch (const std::exception &) {
+      // itk::ExceptionObject, or a frame ReadDICOMFrame could not decode
+      encoded.clear();
+    }
+    header.push_back(static_cast<uint32_t>(encoded.size()));
+    encodedFiles += encoded;
+  }
+
+  auto &stream = thumbnailsStream.Get();
+  stream.write(reinterpret_cast<const char *>(header.data()),
+               header.size() * sizeof(uint32_t));
+  stream.write(encodedFiles.data(), encodedFiles.size());
+
+  // Clean up files
+  for (auto &file : files) {
+    remove(file.c_str());
+  }
+
+  return EXIT_SUCCESS;
+}
+
+/**
+ * Reads the preview slices as TPixel images and averages them down in-plane.
+ */
+template <typename TPixel>
+int OutputVolumePreview(itk::wasm::Pipeline &pipeline,
+                        const FileNamesContainer &files,
+                        unsigned int shrinkFactor, DicomIO *dicomIO) {
+  using NativeImageType = itk::Image<TPixel, 3>;
+  using NativeSeriesReaderType = itk::ImageSeriesReader<NativeImageType>;
+
+  // outputs
+  using WasmOutputImageType = itk::wasm::OutputImage<NativeImageType>;
+  WasmOutputImageType outputImage;
+  pipeline.add_option("OutputImage", outputImage, "The preview volume")
+      ->required();
+
+  ITK_WASM_PARSE(pipeline);
+
+  typename NativeSeriesReaderType::Pointer reader =
+      NativeSeriesReaderType::New();
+  reader->SetImageIO(dicomIO);
+  reader->SetFileNames(files);
+  reader->SetMetaDataDictionaryArrayUpdate(false);
+
+  using ShrinkFilter =
+      itk::BinShrinkImageFilter<NativeImageType, NativeImageType>;
+  typename ShrinkFilter::Pointer shrinkFilter = ShrinkFilter::New();
+  shrinkFilter->SetInput(reader->GetOutput());
+  shrinkFilter->SetShrinkFactor(0, shrinkFactor);
+  shrinkFilter->SetShrinkFactor(1, shrinkFactor);
+  shrinkFilter->SetShrinkFactor(2, 1);
+  shrinkFilter->Update();
+
+  outputImage.Set(shrinkFilter->GetOutput());
+
+  return EXIT_SUCCESS;
+}
+
+/**
+ * buildVolumePreview reads a coarse volume out of some of the files of a
+ * series, to show while the full volume is being built.
+ *
+ * The caller picks the slices, typically every k-th file in the slice order
+ * returned by categorize, so only those are copied to the module. Each slice
+ * is then averaged down in-plane by --shrink. The slice spacing follows from
+ * the positions of the given files, so the preview covers the same physical
+ * extent as the full volume.
+ *
+ * The preview has the component type GDCMImageIO reads the first file as, as
+ * the full volume does, so replacing one with the other keeps the scalar
+ * type. Color series are still previewed as float intensities.
+ */
+int buildVolumePreview(itk::wasm::Pipeline &pipeline) {
+
+  // inputs
+  FileNamesContainer files;
+  pipeline.add_option("-f,--files", files, "File names of the slices, in order")
+      ->required()
+      ->check(CLI::ExistingFile)
+      ->expected(1, -1);
+
+  unsigned int shrinkFactor = 1;
+  pipeline
+      .add_option("-s,--shrink", shrinkFactor,
+                  "In-plane shrink factor of the slices")
+      ->check(CLI::PositiveNumber);
+
+  ITK_WASM_PRE_PARSE(pipeline);
+
+  typename DicomIO::Pointer dicomIO = DicomIO::New();
+  dicomIO->LoadPrivateTagsOff();
+  dicomIO->SetFileName(files[0]);
+  dicomIO->ReadImageInformation();
+
+  const itk::IOComponentEnum componentType =
+      dicomIO->GetPixelType() == itk::IOPixelEnum::SCALAR
+          ? dicomIO->GetComponentType()
+          : itk::IOComponentEnum::FLOAT;
+
+  int result = EXIT_SUCCESS;
+  switch (componentType) {
+  case itk::IOComponentEnum::UCHAR:
+    result = OutputVolumePreview<uint8_t>(pipeline, files, shrinkFactor,
+                                          dicomIO);
+    break;
+  case itk::IOComponentEnum::CHAR:
+    result =
+        OutputVolumePreview<int8_t>(pipeline, files, shrinkFactor, dicomIO);
+    break;
+  case itk::IOComponentEnum::USHORT:
+    result = OutputVolumePreview<uint16_t>(pipeline, files, shrinkFactor,
+                                           dicomIO);
+    break;
+  case itk::IOComponentEnum::SHORT:
+    result = OutputVolumePreview<int16_t>(pipeline, files, shrinkFactor,
+                                          dicomIO);
+    break;
+  case itk::IOComponentEnum::UINT:
+    result = OutputVolumePreview<uint32_t>(pipeline, files, shrinkFactor,
+                                           dicomIO);
+    break;
+  case itk::IOComponentEnum::INT:
+    result = OutputVolumePreview<int32_t>(pipeline, files, shrinkFactor,
+                                          dicomIO);
+    break;
+  case itk::IOComponentEnum::DOUBLE:
+    result =
+        OutputVolumePreview<double>(pipeline, files, shrinkFactor, dicomIO);
+    break;
+  default:
+    result =
+        OutputVolumePreview<float>(pipeline, files, shrinkFactor, dicomIO);
+    break;
+  }
+
+  // Clean up files
+  for (auto &file : files) {
+    remove(file.c_str());
+  }
+
+  return result;
+}
+
+/**
+ * Resamples a volume onto the grid given by --size, --spacing, --origin and
+ * --direction, with linear interpolation.
+ *
+ * This mirrors the resample pipeline for volumes that are already in this
+ * module's worker, so they need not be sent to a second module and worker.
+ */
+template <typename TImage> class ResampleFunctor {
+public:
+  int operator()(itk::wasm::Pipeline &pipeline) {
+    using WasmInputImageType = itk::wasm::InputImage<TImage>;
+    WasmInputImageType inputImage;
+    pipeline.add_option("InputImage", inputImage, "The volume to resample")
+        ->required();
+
+    std::vector<unsigned int> outSize;
+    pipeline.add_option("-z,--size", outSize, "Size of the output grid")
+        ->required()
+        ->expected(3)
+        ->delimiter(',');
+
+    std::vector<double> outSpacing;
+    pipeline
+        .add_option("-p,--spacing", outSpacing, "Spacing of the output grid")
+        ->required()
+        ->expected(3)
+        ->delimiter(',');
+
+    std::vector<double> outOrigin;
+    pipeline.add_option("-o,--origin", outOrigin, "Origin of the output grid")
+        ->required()
+        ->expected(3)
+        ->delimiter(',');
+
+    std::vector<double> outDirection;
+    pipeline
+        .add_option("-d,--direction", outDirection,
+                    "Direction of the output grid, row by row")
+        ->required()
+        ->expected(9)
+        ->delimiter(',');
+
+    // outputs
+    using WasmOutputImageType = itk::wasm::OutputImage<TImage>;
+    WasmOutputImageType outputImage;
+    pipeline.add_option("OutputImage", outputImage, "The resampled volume")
+        ->required();
+
+    ITK_WASM_PARSE(pipeline);
+
+    typename TImage::SizeType size;
+    typename TImage::SpacingType spacing;
+    typename TImage::PointType origin;
+    typename TImage::DirectionType direction;
+    for (unsigned int row = 0; row < 3; row++) {
+      size[row] = outSize[row];
+      spacing[row] = outSpacing[row];
+      origin[row] = outOrigin[row];
+      for (unsigned int col = 0; col < 3; col++) {
+        direction(row, col) = outDirection[row * 3 + col];
+      }
+    }
+
+    using ResampleFilterType = itk::ResampleImageFilter<TImage, TImage>;
+    using InterpolatorType =
+        itk::LinearInterpolateImageFunction<TImage, double>;
+    typename ResampleFilterType::Pointer resampleFilter =
+        ResampleFilterType::New();
+    resampleFilter->SetInput(inputImage.Get());
+    resampleFilter->SetInterpolator(InterpolatorType::New());
+    resampleFilter->SetSize(size);
+    resampleFilter->SetOutputSpacing(spacing);
+    resampleFilter->SetOutputOrigin(origin);
+    resampleFilter->SetOutputDirection(direction);
+    resampleFilter->Update();
+
+    outputImage.Set(resampleFilter->GetOutput());
+
+    return EXIT_SUCCESS;
+  }
+};
+
+/**
+ * resample dispatches on the pixel type of the input volume.
+ */
+int resample(itk::wasm::Pipeline &pipeline) {
+  return itk::wasm::SupportInputImageTypes<
+      ResampleFunctor, uint8_t, int8_t, uint16_t, int16_t, uint32_t, int32_t,
+      float, double>::Dimensions<3U>("InputImage", pipeline);
+}
+
+// 'VPY1', little-endian
+static const uint32_t PyramidBinaryMagic = 0x31595056;
+
+/**
+ * Builds the levels of a power-of-two pyramid of a volume in one pass: each
+ * level is bin shrunk from the one before it, not from the full resolution
+ * volume, so every level costs an eighth of the one before.
+ *
+ * The full resolution level is not sent back. The levels below it are
+ * written in turn, from finest to coarsest, to one binary stream in host
+ * order:
+ *
+ *   magic, count N: uint32
+ *   then for each level, starting on an 8-byte boundary:
+ *     size[3], padding: uint32
+ *     spacing[3], origin[3]: double
+ *     pixels:            size[0] * size[1] * size[2] pixels, zero padded to
+ *                        8 bytes
+ *
+ * Levels share the direction of the input.
+ */
+template <typename TImage> class BuildPyramidFunctor {
+public:
+  int operator()(itk::wasm::Pipeline &pipeline) {
+    using PixelType = typename TImage::PixelType;
+
+    using WasmInputImageType = itk::wasm::InputImage<TImage>;
+    WasmInputImageType inputImage;
+    pipeline.add_option("InputImage", inputImage, "The full resolution volume")
+        ->required();
+
+    unsigned int levels = 0;
+    pipeline.add_option(
+        "--levels", levels,
+        "Most levels to build, with the full resolution one (0: all)");
+
+    // outputs
+    itk::wasm::OutputBinaryStream pyramidStream;
+    pipeline
+        .add_option("pyramid", pyramidStream,
+                    "The levels below full resolution, finest first")
+        ->required();
+
+    ITK_WASM_PARSE(pipeline);
+
+    typename TImage::ConstPointer level = inputImage.Get();
+    const auto sizes =
+        pyramidLevelSizes(level->GetLargestPossibleRegion().GetSize(), levels);
+
+    auto &stream = pyramidStream.Get();
+    const uint32_t header[2]{PyramidBinaryMagic,
+                             static_cast<uint32_t>(sizes.size())};
+    stream.write(reinterpret_cast<const char *>(header), sizeof(header));
+
+    using ShrinkFilter = itk::BinShrinkImageFilter<TImage, TImage>;
+    for (size_t i = 0; i < sizes.size(); i++) {
+      const auto previousSize = level->GetLargestPossibleRegion().GetSize();
+      typename ShrinkFilter::Pointer shrinkFilter = ShrinkFilter::New();
+      shrinkFilter->SetInput(level);
+      for (unsigned int d = 0; d < 3; d++) {
+        shrinkFilter->SetShrinkFactor(d, previousSize[d] > 1 ? 2 : 1);
+      }
+      shrinkFilter->Update();
+      typename TImage::Pointer shrunk = shrinkFilter->GetOutput();
+      shrunk->DisconnectPipeline();
+
+      const auto &size = shrunk->GetLargestPossibleRegion().GetSize();
+      const uint32_t sizeWords[4]{static_cast<uint32_t>(size[0]),
+                                  static_cast<uint32_t>(size[1]),
+                                  static_cast<uint32_t>(size[2]), 0};
+      double geometry[6];
+      for (unsigned int d = 0; d < 3; d++) {
+        geometry[d] = shrunk->GetSpacing()[d];
+        geometry[3 + d] = shrunk->GetOrigin()[d];
+      }
+      const size_t pixelBytes =
+          shrunk->GetLargestPossibleRegion().GetNumberOfPixels() *
+          sizeof(PixelType);
+      const char padding[8]{};
+
+      stream.write(reinterpret_cast<const char *>(sizeWords),
+                   sizeof(sizeWords));
+      stream.write(reinterpret_cast<const char *>(geometry), sizeof(geometry));
+      stream.write(reinterpret_cast<const char *>(shrunk->GetBufferPointer()),
+                   pixelBytes);
+      stream.write(padding, (8 - pixelBytes % 8) % 8);
+
+      level = shrunk;
+    }
+
+    return EXIT_SUCCESS;
+  }
+};
+
+/**
+ * buildPyramid dispatches on the pixel type of the input volume.
+ */
+int buildPyramid(itk::wasm::Pipeline &pipeline) {
+  return itk::wasm::SupportInputImageTypes<
+      BuildPyramidFunctor, uint8_t, int8_t, uint16_t, int16_t, uint32_t,
+      int32_t, float, double>::Dimensions<3U>("InputImage", pipeline);
+}
+
+// 'TAG1', little-endian
+static const uint32_t TagTableBinaryMagic = 0x31474154;
+
+// Trailing padding of DICOM string values.
+std::string trimPadding(std::string value) {
+  const auto end = value.find_last_not_of(std::string(" \0", 2));
+  value.erase(end == std::string::npos ? 0 : end + 1);
+  return value;
+}
+
+/**
+ * readTags reads the same tags out of many files in a single call, parsing
+ * each header only up to the pixel data.
+ *
+ * The values are written as stored, without decoding their character set, to
+ * one binary stream of uint32 fields in host order followed by bytes:
+ *
+ *   magic, fileCount F, tagCount T
+ *   offsets[F T + 1]: tag t of file f is values[offsets[f T + t] ..
+ *                     offsets[f T + t + 1])
+ *   values:           the values as concatenated bytes, without their
+ *                     trailing padding. Missing tags and files that are not
+ *                     readable DICOM have empty values.
+ */
+int readTags(itk::wasm::Pipeline &pipeline) {
+
+  // inputs
+  FileNamesContainer files;
+  pipeline.add_option("-f,--files", files, "File names to read tags from")
+      ->required()
+      ->check(CLI::ExistingFile)
+      ->expected(1, -1);
+
+  std::vector<std::string> tagNames;
+  pipeline.add_option("--tags", tagNames, "Tags to read, as gggg|eeee")
+      ->required()
+      ->expected(1, -1);
+
+  // outputs
+  itk::wasm::OutputBinaryStream tagTableStream;
+  pipeline
+      .add_option("tagTable", tagTableStream,
+                  "The tag values of the files, in order")
+      ->required();
+
+  ITK_WASM_PARSE(pipeline);
+
+  std::vector<gdcm::Tag> tags(tagNames.size());
+  for (size_t t = 0; t < tags.size(); t++) {
+    if (!tags[t].ReadFromPipeSeparatedString(tagNames[t].c_str())) {
+      throw std::runtime_error("Invalid tag: " + tagNames[t]);
+    }
+  }
+
+  std::vector<uint32_t> header{TagTableBinaryMagic,
+                               static_cast<uint32_t>(files.size()),
+                               static_cast<uint32_t>(tags.size())};
+  std::vector<uint32_t> offsets{0};
+  std::string values;
+  for (const auto &fileName : files) {
+    gdcm::Reader reader;
+    reader.SetFileName(fileName.c_str());
+    const bool readable = reader.ReadUpToTag(gdcm::Tag(0x7fe0, 0x0010));
+
+    gdcm::StringFilter stringFilter;
+    stringFilter.SetFile(reader.GetFile());
+    for (const auto &tag : tags) {
+      if (readable) {
+        values += trimPadding(stringFilter.ToString(tag));
+      }
+      offsets.push_back(static_cast<uint32_t>(values.size()));
+    }
+  }
+
+  auto &stream = tagTableStream.Get();
+  stream.write(reinterpret_cast<const char *>(header.data()),
+               header.size() * sizeof(uint32_t));
+  stream.write(reinterpret_cast<const char *>(offsets.data()),
+               offsets.size() * sizeof(uint32_t));
+  stream.write(values.data(), values.size());
+
+  // Clean up files
+  for (auto &file : files) {
+    remove(file.c_str());
+  }
 
   return EXIT_SUCCESS;
 }
@@ -309,7 +1640,10 @@ int main(int argc, char *argv[]) {
   itk::wasm::Pipeline pipeline("DICOM-VolView", "VolView pipeline to access DICOM data", argc,
                                argv);
   pipeline.add_option("-a,--action", action, "The action to run")
-      ->check(CLI::IsMember({"categorize", "getSliceImage"}));
+      ->check(CLI::IsMember({"categorize", "categorizeBatch", "getSliceImage",
+                             "getThumbnails", "readTags",
+                             "buildVolumePreview", "resample",
+                             "buildPyramid"}));
 
   // Pre parse so we can get the action
   ITK_WASM_PRE_PARSE(pipeline)
@@ -318,9 +1652,33 @@ int main(int argc, char *argv[]) {
 
     ITK_WASM_CATCH_EXCEPTION(pipeline, categorizeFiles(pipeline));
 
+  } else if (action == "categorizeBatch") {
+
+    ITK_WASM_CATCH_EXCEPTION(pipeline, categorizeBatch(pipeline));
+
   } else if (action == "getSliceImage") {
 
     ITK_WASM_CATCH_EXCEPTION(pipeline, getSliceImage(pipeline));
+
+  } else if (action == "getThumbnails") {
+
+    ITK_WASM_CATCH_EXCEPTION(pipeline, getThumbnails(pipeline));
+
+  } else if (action == "readTags") {
+
+    ITK_WASM_CATCH_EXCEPTION(pipeline, readTags(pipeline));
+
+  } else if (action == "buildVolumePreview") {
+
+    ITK_WASM_CATCH_EXCEPTION(pipeline, buildVolumePreview(pipeline));
+
+  } else if (action == "resample") {
+
+    ITK_WASM_CATCH_EXCEPTION(pipeline, resample(pipeline));
+
+  } else if (action == "buildPyramid") {
+
+    ITK_WASM_CATCH_EXCEPTION(pipeline, buildPyramid(pipeline));
   }
 
   return EXIT_SUCCESS;
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+/**
+ * Least recently used cache of values keyed by string, bounded by the total
+ * size in bytes given for its values.
+ */
+template <typename TValue> class LRUCache {
+public:
+  explicit LRUCache(size_t budget) : m_Budget(budget) {}
+
+  /**
+   * Returns the value cached under key and marks it as the most recently
+   * used, or returns nullptr. Either way counts as a hit or a miss.
+   *
+   * The pointer is valid until the value is evicted.
+   */
+  const TValue *Get(const std::string &key) {
+    auto found = m_Index.find(key);
+    if (found == m_Index.end()) {
+      m_Misses++;
+      return nullptr;
+    }
+    m_Hits++;
+    m_Entries.splice(m_Entries.begin(), m_Entries, found->second);
+    return &found->second->value;
+  }
+
+  /**
+   * Caches value under key, then evicts the least recently used values until
+   * the cache fits its budget. A value larger than the budget is not cached.
+   */
+  void Put(const std::string &key, TValue value, size_t bytes) {
+    Erase(key);
+    if (bytes > m_Budget) {
+      return;
+    }
+    m_Entries.push_front(Entry{key, std::move(value), bytes});
+    m_Index[key] = m_Entries.begin();
+    m_Bytes += bytes;
+    Evict();
+  }
+
+  void Erase(const std::string &key) {
+    auto found = m_Index.find(key);
+    if (found == m_Index.end()) {
+      return;
+    }
+    m_Bytes -= found->second->bytes;
+    m_Entries.erase(found->second);
+    m_Index.erase(found);
+  }
+
+  void SetBudget(size_t budget) {
+    m_Budget = budget;
+    Evict();
+  }
+
+  size_t Size() const { return m_Entries.size(); }
+  size_t Bytes() const { return m_Bytes; }
+  size_t Budget() const { return m_Budget; }
+  uint64_t Hits() const { return m_Hits; }
+  uint64_t Misses() const { return m_Misses; }
+
+private:
+  struct Entry {
+    std::string key;
+    TValue value;
+    size_t bytes;
+  };
+
+  void Evict() {
+    while (m_Bytes > m_Budget) {
+      const auto &oldest = m_Entries.back();
+      m_Bytes -= oldest.bytes;
+      m_Index.erase(oldest.key);
+      m_Entries.pop_back();
+    }
+  }
+
+  size_t m_Budget;
+  size_t m_Bytes = 0;
+  uint64_t m_Hits = 0;
+  uint64_t m_Misses = 0;
+  // most recently used first
+  std::list<Entry> m_Entries;
+  std::unordered_map<std::string, typename std::list<Entry>::iterator>
+      m_Index;
+};
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <vector>
+
+/**
+ * Sizes of the levels of a power-of-two pyramid below size: each axis is
+ * halved, rounding down, until every axis is one voxel, or until levels
+ * levels including size itself are reached. Axes of one voxel stay as they
+ * are.
+ */
+template <typename TSize>
+inline std::vector<TSize> pyramidLevelSizes(const TSize &size,
+                                            unsigned int levels) {
+  std::vector<TSize> sizes;
+  TSize level = size;
+  while (levels == 0 || sizes.size() + 1 < levels) {
+    bool shrunk = false;
+    for (unsigned int d = 0; d < TSize::Dimension; d++) {
+      if (level[d] > 1) {
+        level[d] /= 2;
+        shrunk = true;
+      }
+    }
+    if (!shrunk) {
+      break;
+    }
+    sizes.push_back(level);
+  }
+  return sizes;
+}
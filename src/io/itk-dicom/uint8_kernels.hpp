@@ -0,0 +1,255 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/**
+ * Finds the smallest and largest of count values, or 0 and 0 if there are
+ * none.
+ */
+template <typename T>
+inline void minMaxIntensity(const T *values, size_t count, double &minimum,
+                            double &maximum) {
+  if (count == 0) {
+    minimum = maximum = 0;
+    return;
+  }
+  T low = values[0];
+  T high = values[0];
+  for (size_t i = 1; i < count; i++) {
+    low = std::min(low, values[i]);
+    high = std::max(high, values[i]);
+  }
+  minimum = low;
+  maximum = high;
+}
+
+#if defined(__SSE2__)
+template <>
+inline void minMaxIntensity<float>(const float *values, size_t count,
+                                   double &minimum, double &maximum) {
+  if (count == 0) {
+    minimum = maximum = 0;
+    return;
+  }
+  float lowest = values[0];
+  float highest = values[0];
+  size_t i = 0;
+  if (count >= 4) {
+    __m128 low = _mm_loadu_ps(values);
+    __m128 high = low;
+    for (i = 4; i + 4 <= count; i += 4) {
+      const __m128 v = _mm_loadu_ps(values + i);
+      low = _mm_min_ps(low, v);
+      high = _mm_max_ps(high, v);
+    }
+    float lows[4];
+    float highs[4];
+    _mm_storeu_ps(lows, low);
+    _mm_storeu_ps(highs, high);
+    lowest = std::min(std::min(lows[0], lows[1]), std::min(lows[2], lows[3]));
+    highest =
+        std::max(std::max(highs[0], highs[1]), std::max(highs[2], highs[3]));
+  }
+  for (; i < count; i++) {
+    lowest = std::min(lowest, values[i]);
+    highest = std::max(highest, values[i]);
+  }
+  minimum = lowest;
+  maximum = highest;
+}
+
+/**
+ * SSE2 only compares signed 16-bit lanes, so uint16_t values are biased by
+ * 0x8000 into int16_t order while they are compared.
+ */
+template <typename T>
+inline void minMaxIntensity16(const T *values, size_t count, double &minimum,
+                              double &maximum) {
+  static_assert(sizeof(T) == 2, "16-bit values only");
+  if (count == 0) {
+    minimum = maximum = 0;
+    return;
+  }
+  T lowest = values[0];
+  T highest = values[0];
+  size_t i = 0;
+  if (count >= 8) {
+    const __m128i bias = _mm_set1_epi16(
+        std::is_signed<T>::value ? 0 : static_cast<short>(0x8000));
+    __m128i low = _mm_xor_si128(
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(values)), bias);
+    __m128i high = low;
+    for (i = 8; i + 8 <= count; i += 8) {
+      const __m128i v = _mm_xor_si128(
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(values + i)), bias);
+      low = _mm_min_epi16(low, v);
+      high = _mm_max_epi16(high, v);
+    }
+    T lows[8];
+    T highs[8];
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(lows),
+                     _mm_xor_si128(low, bias));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(highs),
+                     _mm_xor_si128(high, bias));
+    lowest = *std::min_element(lows, lows + 8);
+    highest = *std::max_element(highs, highs + 8);
+  }
+  for (; i < count; i++) {
+    lowest = std::min(lowest, values[i]);
+    highest = std::max(highest, values[i]);
+  }
+  minimum = lowest;
+  maximum = highest;
+}
+
+template <>
+inline void minMaxIntensity<int16_t>(const int16_t *values, size_t count,
+                                     double &minimum, double &maximum) {
+  minMaxIntensity16(values, count, minimum, maximum);
+}
+
+template <>
+inline void minMaxIntensity<uint16_t>(const uint16_t *values, size_t count,
+                                      double &minimum, double &maximum) {
+  minMaxIntensity16(values, count, minimum, maximum);
+}
+#endif
+
+/**
+ * Linear map to uint8: value * factor + offset, clamped to [0, 255] and
+ * truncated, as itk::IntensityWindowingImageFilter does. NaN maps to 0.
+ */
+struct Uint8Mapping {
+  float factor;
+  float offset;
+};
+
+/**
+ * Maps [lower, upper] onto [0, 255], or onto [255, 0] when inverted. An empty
+ * range maps every value to the low end of the output.
+ */
+inline Uint8Mapping uint8Mapping(double lower, double upper, bool inverted) {
+  const double outputMinimum = inverted ? 255 : 0;
+  const double outputMaximum = inverted ? 0 : 255;
+  if (!(upper > lower)) {
+    return {0, static_cast<float>(outputMinimum)};
+  }
+  const double factor = (outputMaximum - outputMinimum) / (upper - lower);
+  return {static_cast<float>(factor),
+          static_cast<float>(outputMinimum - lower * factor)};
+}
+
+/**
+ * Writes count values mapped to uint8 in a single pass, with no intermediate
+ * buffer.
+ */
+template <typename T>
+inline void mapToUint8(const T *values, size_t count,
+                       const Uint8Mapping &mapping, uint8_t *output) {
+  for (size_t i = 0; i < count; i++) {
+    float value =
+        static_cast<float>(values[i]) * mapping.factor + mapping.offset;
+    value = value > 0 ? std::min(value, 255.f) : 0;
+    output[i] = static_cast<uint8_t>(value);
+  }
+}
+
+#if defined(__SSE2__)
+/**
+ * Maps four values as mapToUint8 does, leaving them in 32-bit lanes.
+ */
+inline __m128i mapLanesToUint8(__m128 values, const Uint8Mapping &mapping) {
+  values = _mm_add_ps(_mm_mul_ps(values, _mm_set1_ps(mapping.factor)),
+                      _mm_set1_ps(mapping.offset));
+  // max returns its second operand for NaN
+  values = _mm_min_ps(_mm_max_ps(values, _mm_setzero_ps()), _mm_set1_ps(255.f));
+  return _mm_cvttps_epi32(values);
+}
+
+/**
+ * Packs four vectors of 32-bit lanes in [0, 255] into 16 bytes.
+ */
+inline void storeUint8(const __m128i words[4], uint8_t *output) {
+  const __m128i shorts0 = _mm_packs_epi32(words[0], words[1]);
+  const __m128i shorts1 = _mm_packs_epi32(words[2], words[3]);
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(output),
+                   _mm_packus_epi16(shorts0, shorts1));
+}
+
+/**
+ * The SSE2 paths map 16 values per iteration, and then pack them with
+ * saturation down to 16 bytes.
+ */
+template <>
+inline void mapToUint8<float>(const float *values, size_t count,
+                              const Uint8Mapping &mapping, uint8_t *output) {
+  size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    __m128i words[4];
+    for (int k = 0; k < 4; k++) {
+      words[k] = mapLanesToUint8(_mm_loadu_ps(values + i + 4 * k), mapping);
+    }
+    storeUint8(words, output + i);
+  }
+  for (; i < count; i++) {
+    float value = values[i] * mapping.factor + mapping.offset;
+    value = value > 0 ? std::min(value, 255.f) : 0;
+    output[i] = static_cast<uint8_t>(value);
+  }
+}
+
+/**
+ * 16-bit values are widened to 32-bit lanes, with sign extension for
+ * int16_t, and converted to float exactly.
+ */
+template <typename T>
+inline void mapToUint8From16(const T *values, size_t count,
+                             const Uint8Mapping &mapping, uint8_t *output) {
+  static_assert(sizeof(T) == 2, "16-bit values only");
+  size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    __m128i words[4];
+    for (int k = 0; k < 2; k++) {
+      const __m128i v = _mm_loadu_si128(
+          reinterpret_cast<const __m128i *>(values + i + 8 * k));
+      __m128i low, high;
+      if (std::is_signed<T>::value) {
+        low = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+        high = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+      } else {
+        low = _mm_unpacklo_epi16(v, _mm_setzero_si128());
+        high = _mm_unpackhi_epi16(v, _mm_setzero_si128());
+      }
+      words[2 * k] = mapLanesToUint8(_mm_cvtepi32_ps(low), mapping);
+      words[2 * k + 1] = mapLanesToUint8(_mm_cvtepi32_ps(high), mapping);
+    }
+    storeUint8(words, output + i);
+  }
+  for (; i < count; i++) {
+    float value =
+        static_cast<float>(values[i]) * mapping.factor + mapping.offset;
+    value = value > 0 ? std::min(value, 255.f) : 0;
+    output[i] = static_cast<uint8_t>(value);
+  }
+}
+
+template <>
+inline void mapToUint8<int16_t>(const int16_t *values, size_t count,
+                                const Uint8Mapping &mapping, uint8_t *output) {
+  mapToUint8From16(values, count, mapping, output);
+}
+
+template <>
+inline void mapToUint8<uint16_t>(const uint16_t *values, size_t count,
+                                 const Uint8Mapping &mapping,
+                                 uint8_t *output) {
+  mapToUint8From16(values, count, mapping, output);
+}
+#endif
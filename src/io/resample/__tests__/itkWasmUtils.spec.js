@@ -0,0 +1,50 @@
+import { describe, it } from 'vitest';
+import { expect } from 'chai';
+
+import { cropImage } from '@src/io/resample/itkWasmUtils';
+
+function makeImage(size, components, TypedArray) {
+  const length = size.reduce((count, s) => count * s, components);
+  return {
+    imageType: { dimension: size.length, components },
+    name: 'image',
+    origin: size.map(() => 1),
+    spacing: size.map(() => 0.5),
+    direction: new Float64Array(size.length * size.length),
+    size,
+    metadata: new Map(),
+    data: TypedArray.from({ length }, (_, i) => i),
+  };
+}
+
+describe('cropImage', () => {
+  it('should copy the voxels of a 3D region', () => {
+    const image = makeImage([4, 3, 2], 1, Int16Array);
+    const crop = cropImage(image, { index: [1, 1, 1], size: [2, 2, 1] });
+
+    expect(crop.size).to.deep.equal([2, 2, 1]);
+    expect(crop.data).to.be.instanceOf(Int16Array);
+    // voxel (x, y, z) holds z * 12 + y * 4 + x
+    expect(Array.from(crop.data)).to.deep.equal([17, 18, 21, 22]);
+  });
+
+  it('should keep the geometry without sharing it', () => {
+    const image = makeImage([4, 3, 2], 1, Float32Array);
+    const crop = cropImage(image, { index: [0, 0, 0], size: [4, 3, 2] });
+
+    expect(Array.from(crop.data)).to.deep.equal(Array.from(image.data));
+    expect(crop.data).to.not.equal(image.data);
+    expect(crop.origin).to.deep.equal(image.origin);
+    expect(crop.spacing).to.deep.equal(image.spacing);
+    expect(crop.direction).to.deep.equal(image.direction);
+    expect(crop.direction).to.not.equal(image.direction);
+  });
+
+  it('should copy every component of 2D pixels', () => {
+    const image = makeImage([3, 2], 2, Uint8Array);
+    const crop = cropImage(image, { index: [1, 0], size: [2, 2] });
+
+    expect(crop.size).to.deep.equal([2, 2]);
+    expect(Array.from(crop.data)).to.deep.equal([2, 3, 4, 5, 8, 9, 10, 11]);
+  });
+});
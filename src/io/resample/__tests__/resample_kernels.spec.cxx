@@ -0,0 +1,224 @@
+#include "itkImage.h"
+#include "itkImageRegionConstIteratorWithIndex.h"
+#include "itkLinearInterpolateImageFunction.h"
+#include "itkNearestNeighborInterpolateImageFunction.h"
+#include "itkResampleImageFilter.h"
+#include "itkTranslationTransform.h"
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+
+#include "../resample_kernels.h"
+#include "../../itk-dicom/__tests__/expect.hpp"
+
+// Rotation about the last axis, so directions are not the identity.
+template <typename TDirection>
+TDirection
+Rotation(double angle)
+{
+  TDirection direction;
+  direction.SetIdentity();
+  direction(0, 0) = std::cos(angle);
+  direction(0, 1) = -std::sin(angle);
+  direction(1, 0) = std::sin(angle);
+  direction(1, 1) = std::cos(angle);
+  return direction;
+}
+
+// An input with random pixels whose buffer starts at start, as a crop sent
+// with --input-index does.
+template <typename TImage>
+typename TImage::Pointer
+MakeInput(const typename TImage::IndexType & start)
+{
+  constexpr unsigned int Dimension = TImage::ImageDimension;
+  const itk::SizeValueType sizes[] = { 13, 11, 7 };
+  const double             spacings[] = { 0.71, 0.9, 2.5 };
+  const double             origins[] = { -3., 4., 10. };
+
+  typename TImage::RegionType region;
+  typename TImage::SpacingType spacing;
+  typename TImage::PointType   origin;
+  for (unsigned int d = 0; d < Dimension; ++d)
+  {
+    region.SetIndex(d, start[d]);
+    region.SetSize(d, sizes[d]);
+    spacing[d] = spacings[d];
+    origin[d] = origins[d];
+  }
+
+  auto input = TImage::New();
+  input->SetRegions(region);
+  input->SetSpacing(spacing);
+  input->SetOrigin(origin);
+  input->SetDirection(Rotation<typename TImage::DirectionType>(0.3));
+  input->Allocate();
+
+  std::mt19937                       random(42);
+  std::uniform_int_distribution<int> intensity(-1000, 3000);
+  auto *                             pixels = input->GetBufferPointer();
+  for (itk::SizeValueType i = 0; i < region.GetNumberOfPixels(); ++i)
+  {
+    pixels[i] = static_cast<typename TImage::PixelType>(intensity(random));
+  }
+  return input;
+}
+
+// What the pipeline computes without the axis aligned path.
+template <typename TImage>
+typename TImage::Pointer
+ResampleWithFilter(const TImage *                         input,
+                   const typename TImage::RegionType &    outputRegion,
+                   const typename TImage::SpacingType &   outputSpacing,
+                   const typename TImage::PointType &     outputOrigin,
+                   const typename TImage::DirectionType & outputDirection,
+                   bool                                   nearest)
+{
+  using FilterType = itk::ResampleImageFilter<TImage, TImage>;
+  auto filter = FilterType::New();
+  filter->SetInput(input);
+  if (nearest)
+  {
+    filter->SetInterpolator(itk::NearestNeighborInterpolateImageFunction<TImage, double>::New());
+  }
+  else
+  {
+    filter->SetInterpolator(itk::LinearInterpolateImageFunction<TImage, double>::New());
+  }
+  filter->SetOutputStartIndex(outputRegion.GetIndex());
+  filter->SetSize(outputRegion.GetSize());
+  filter->SetOutputSpacing(outputSpacing);
+  filter->SetOutputOrigin(outputOrigin);
+  filter->SetOutputDirection(outputDirection);
+  filter->Update();
+  return filter->GetOutput();
+}
+
+// The output region reaches past the input on every side, so taps are
+// clamped and some voxels are outside the input. The grids are offset so no
+// output voxel falls exactly half way between input voxels, where rounding
+// of the two computations could tell them apart.
+template <typename TImage>
+void
+TestMatchesFilter(double tolerance)
+{
+  constexpr unsigned int Dimension = TImage::ImageDimension;
+  const itk::IndexValueType starts[] = { 4, -2, 3 };
+  const itk::IndexValueType outputStarts[] = { 0, 3, 2 };
+  const itk::SizeValueType  outputSizes[] = { 31, 29, 17 };
+  const double              outputSpacings[] = { 0.43, 0.53, 1.3 };
+  const double              outputOffsets[] = { -1.13, -2.27, -4.7 };
+
+  typename TImage::IndexType start;
+  for (unsigned int d = 0; d < Dimension; ++d)
+  {
+    start[d] = starts[d];
+  }
+  const auto input = MakeInput<TImage>(start);
+
+  typename TImage::RegionType  outputRegion;
+  typename TImage::SpacingType outputSpacing;
+  typename TImage::IndexType   firstIndex;
+  for (unsigned int d = 0; d < Dimension; ++d)
+  {
+    outputRegion.SetIndex(d, outputStarts[d]);
+    outputRegion.SetSize(d, outputSizes[d]);
+    outputSpacing[d] = outputSpacings[d];
+    firstIndex[d] = start[d];
+  }
+  // shifted along the input's own axes, so both grids share a direction
+  typename TImage::PointType outputOrigin;
+  input->TransformIndexToPhysicalPoint(firstIndex, outputOrigin);
+  for (unsigned int row = 0; row < Dimension; ++row)
+  {
+    for (unsigned int d = 0; d < Dimension; ++d)
+    {
+      outputOrigin[row] += input->GetDirection()(row, d) * outputOffsets[d];
+    }
+  }
+
+  for (bool nearest : { false, true })
+  {
+    const auto output = ResampleAxisAligned<TImage>(
+      input, outputRegion, outputSpacing, outputOrigin, input->GetDirection(), nearest);
+    const auto expected =
+      ResampleWithFilter<TImage>(input, outputRegion, outputSpacing, outputOrigin, input->GetDirection(), nearest);
+
+    EXPECT(output->GetBufferedRegion() == expected->GetBufferedRegion());
+    itk::SizeValueType outside = 0;
+    itk::SizeValueType mismatches = 0;
+    for (itk::ImageRegionConstIteratorWithIndex<TImage> it(expected, outputRegion); !it.IsAtEnd(); ++it)
+    {
+      typename TImage::PointType point;
+      expected->TransformIndexToPhysicalPoint(it.GetIndex(), point);
+      itk::ContinuousIndex<double, Dimension> inputIndex;
+      input->TransformPhysicalPointToContinuousIndex(point, inputIndex);
+      if (!input->GetBufferedRegion().IsInside(inputIndex))
+      {
+        ++outside;
+      }
+
+      const double difference = std::abs(static_cast<double>(output->GetPixel(it.GetIndex())) - it.Get());
+      // nearest neighbor copies pixels, linear may only differ in rounding
+      if (nearest ? difference != 0. : difference > tolerance)
+      {
+        ++mismatches;
+      }
+    }
+    EXPECT(outside > 0);
+    EXPECT(outside < outputRegion.GetNumberOfPixels());
+    EXPECT(mismatches == 0);
+  }
+}
+
+// The pipeline falls back to ResampleImageFilter whenever the axis aligned
+// path would not compute the same thing.
+void
+TestFallbackConditions()
+{
+  using ImageType = itk::Image<float, 3>;
+  using DirectionType = ImageType::DirectionType;
+  const auto input = MakeInput<ImageType>(ImageType::IndexType{ { 0, 0, 0 } });
+  const auto rotation = Rotation<DirectionType>(0.3);
+
+  using FilterType = itk::ResampleImageFilter<ImageType, ImageType>;
+  auto filter = FilterType::New();
+  const auto * identity = filter->GetTransform();
+
+  EXPECT(CanResampleAxisAligned<ImageType>(input, rotation, "linear", identity));
+  EXPECT(CanResampleAxisAligned<ImageType>(input, rotation, "nearest", identity));
+
+  // within the direction tolerance
+  DirectionType nearly = rotation;
+  nearly(0, 1) += 1e-7;
+  EXPECT(CanResampleAxisAligned<ImageType>(input, nearly, "linear", identity));
+
+  // direction mismatch
+  EXPECT(!CanResampleAxisAligned<ImageType>(input, Rotation<DirectionType>(0.31), "linear", identity));
+  DirectionType identityDirection;
+  identityDirection.SetIdentity();
+  EXPECT(!CanResampleAxisAligned<ImageType>(input, identityDirection, "nearest", identity));
+
+  // interpolators the axis aligned path does not mirror
+  EXPECT(!CanResampleAxisAligned<ImageType>(input, rotation, "label-gaussian", identity));
+  EXPECT(!CanResampleAxisAligned<ImageType>(input, rotation, "bspline", identity));
+
+  // non-identity transform
+  auto translation = itk::TranslationTransform<double, 3>::New();
+  filter->SetTransform(translation);
+  EXPECT(!CanResampleAxisAligned<ImageType>(input, rotation, "linear", filter->GetTransform()));
+}
+
+int
+main()
+{
+  TestMatchesFilter<itk::Image<float, 3>>(1e-3);
+  TestMatchesFilter<itk::Image<float, 2>>(1e-3);
+  // the cast to short truncates, which rounding can move by one
+  TestMatchesFilter<itk::Image<short, 3>>(1.);
+  TestMatchesFilter<itk::Image<unsigned char, 2>>(1.);
+  TestFallbackConditions();
+
+  return expectResult();
+}
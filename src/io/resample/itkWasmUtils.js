@@ -8,11 +8,103 @@ import {
 
 import itkConfig from '@src/io/itk/itkConfig';
 
+const pipelineOptions = {
+  pipelineBaseUrl: itkConfig.pipelinesUrl,
+  pipelineWorkerUrl: itkConfig.pipelineWorkerUrl,
+};
+
+/**
+ * Copies the voxels of region, given as { index, size }, into a new image.
+ * The crop keeps the geometry of the image, its first voxel being at
+ * region.index.
+ */
+export function cropImage(image, { index, size }) {
+  const { components } = image.imageType;
+  const [width, height = 1] = image.size;
+  const rowLength = size[0] * components;
+  const depth = size[2] ?? 1;
+  const data = new image.data.constructor(rowLength * size[1] * depth);
+
+  let target = 0;
+  for (let z = 0; z < depth; z++) {
+    for (let y = 0; y < size[1]; y++) {
+      const row = ((z + (index[2] ?? 0)) * height + y + index[1]) * width;
+      const source = (row + index[0]) * components;
+      data.set(image.data.subarray(source, source + rowLength), target);
+      target += rowLength;
+    }
+  }
+
+  return {
+    ...image,
+    size: [...size],
+    direction: image.direction.slice(),
+    data,
+  };
+}
+
+function isSharedBufferBacked(image) {
+  return (
+    typeof SharedArrayBuffer !== 'undefined' &&
+    image.data.buffer instanceof SharedArrayBuffer
+  );
+}
+
+/**
+ * Asks the pipeline for the input region each split reads, given only the
+ * geometry of the image. Returns null if the pipeline cannot tell.
+ */
+async function planInputRegions(workerPool, pipeline, args, image, splitsArg) {
+  const taskArgs = [
+    '0', // input image
+    ...args,
+    '--max-total-splits',
+    splitsArg,
+    '--input-regions',
+    '0',
+    '--memory-io',
+  ];
+  const inputs = [
+    {
+      type: InterfaceTypes.Image,
+      data: {
+        ...image,
+        direction: image.direction.slice(),
+        // the geometry is all that is read
+        data: new image.data.constructor(0),
+      },
+    },
+  ];
+  const outputs = [{ type: InterfaceTypes.TextStream }];
+
+  try {
+    const [result] = await workerPool.runTasks([
+      [pipeline, taskArgs, outputs, inputs, pipelineOptions],
+    ]).promise;
+    if (result.returnValue !== 0) return null;
+    return JSON.parse(result.outputs[0].data.data);
+  } catch (error) {
+    return null;
+  }
+}
+
+/**
+ * Runs pipeline split along the slowest axis of its output, one split per
+ * worker, and stacks the split outputs.
+ *
+ * With cropInputs, every split is sent only the part of the first image it
+ * reads, as planned by the pipeline's --input-regions output, instead of a
+ * copy of the whole image each. That keeps the copies made for the workers to
+ * about one image in all. A first image already backed by a
+ * SharedArrayBuffer is shared with the workers as it is, so it is not
+ * cropped.
+ */
 export async function runWasm(
   pipeline,
   args,
   images,
-  outputs = [{ type: InterfaceTypes.Image }]
+  outputs = [{ type: InterfaceTypes.Image }],
+  { cropInputs = false } = {}
 ) {
   const numberOfWorkers = navigator.hardwareConcurrency
     ? navigator.hardwareConcurrency
@@ -26,7 +118,15 @@ export async function runWasm(
   );
 
   const splitsArg = splits.toString();
-  const tasks = [...Array(splits).keys()].map((split) => {
+  const workerPool = new WorkerPool(numberOfWorkers, runPipeline);
+
+  const inputRegions =
+    cropInputs && !isSharedBufferBacked(aImage)
+      ? await planInputRegions(workerPool, pipeline, args, aImage, splitsArg)
+      : null;
+  const splitCount = inputRegions ? inputRegions.length : splits;
+
+  const tasks = [...Array(splitCount).keys()].map((split) => {
     const taskArgs = [
       ...[...Array(images.length).keys()].map((num) => num.toString()),
       '0', // input image space
@@ -37,23 +137,23 @@ export async function runWasm(
       split.toString(),
       '--number-of-splits',
       splitsArg,
+      ...(inputRegions
+        ? ['--input-index', inputRegions[split].index.join(',')]
+        : []),
       '--memory-io',
     ];
 
-    const inputs = images.map((image) => ({
+    const inputs = images.map((image, index) => ({
       type: InterfaceTypes.Image,
-      data: imageSharedBufferOrCopy(image),
+      data:
+        inputRegions && index === 0
+          ? cropImage(image, inputRegions[split])
+          : imageSharedBufferOrCopy(image),
     }));
 
-    return [pipeline, taskArgs, outputs, inputs, {
-      pipelineBaseUrl: itkConfig.pipelinesUrl,
-      pipelineWorkerUrl: itkConfig.pipelineWorkerUrl,
-    }];
-
-
+    return [pipeline, taskArgs, outputs, inputs, pipelineOptions];
   });
 
-  const workerPool = new WorkerPool(numberOfWorkers, runPipeline);
   const results = await workerPool.runTasks(tasks).promise;
   workerPool.terminateWorkers();
   const validResults = results.filter((r) => r.returnValue === 0);
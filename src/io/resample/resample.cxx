@@ -19,6 +19,9 @@
 #include "itkVectorImage.h"
 #include "itkResampleImageFilter.h"
 #include "itkLinearInterpolateImageFunction.h"
+#include "itkNearestNeighborInterpolateImageFunction.h"
+#include "itkLabelImageGaussianInterpolateImageFunction.h"
+#include "itkBSplineInterpolateImageFunction.h"
 #include "itkImageRegionSplitterSlowDimension.h"
 #include "itkExtractImageFilter.h"
 #include "itkRGBPixel.h"
@@ -35,12 +38,15 @@
 #include "itkMatrix.h"
 #include "itkVariableLengthVector.h"
 #include "itkVariableSizeMatrix.h"
+#include <algorithm>
+#include <cmath>
 #include <fstream>
 #include "itkPipeline.h"
 #include "itkInputImage.h"
 #include "itkOutputImage.h"
 #include "itkOutputTextStream.h"
 #include "itkSupportInputImageTypes.h"
+#include "resample_kernels.h"
 
 template <typename TImage>
 int Resample(itk::wasm::Pipeline &pipeline, itk::wasm::InputImage<TImage> &inputImage)
@@ -51,7 +57,7 @@ int Resample(itk::wasm::Pipeline &pipeline, itk::wasm::InputImage<TImage> &input
 
   using OutputImageType = itk::wasm::OutputImage<ImageType>;
   OutputImageType outputImage;
-  pipeline.add_option("OutputImage", outputImage, "Output image")->required();
+  auto outputImageOption = pipeline.add_option("OutputImage", outputImage, "Output image");
 
   std::vector<unsigned int> outSize;
   pipeline.add_option("-z,--size", outSize, "New image size for each direction")->expected(2, 3)->delimiter(',');
@@ -65,6 +71,10 @@ int Resample(itk::wasm::Pipeline &pipeline, itk::wasm::InputImage<TImage> &input
   std::vector<double> outDirection;
   pipeline.add_option("-d,--direction", outDirection, "New image direction")->expected(4, 9)->delimiter(',');
 
+  std::string interpolator = "linear";
+  pipeline.add_option("-i,--interpolator", interpolator, "Interpolator: nearest, linear, label-gaussian or bspline")
+    ->check(CLI::IsMember({ "nearest", "linear", "label-gaussian", "bspline" }));
+
   // split args
   unsigned int maxTotalSplits = 1;
   pipeline.add_option("-m,--max-total-splits", maxTotalSplits, "Maximum total splits when processed in parallel");
@@ -75,9 +85,38 @@ int Resample(itk::wasm::Pipeline &pipeline, itk::wasm::InputImage<TImage> &input
   itk::wasm::OutputTextStream numberOfSplitsStream;
   auto numberOfSplitsStreamOption = pipeline.add_option("--number-of-splits", numberOfSplitsStream, "Number of splits");
 
+  // Splits can be sent only the part of the input they read: a first call
+  // with --input-regions, whose input image needs no pixels, writes the input
+  // region of every split as JSON, [{"index": [...], "size": [...]}, ...].
+  // Each split is then sent its crop, with the index of its first voxel.
+  itk::wasm::OutputTextStream inputRegionsStream;
+  auto inputRegionsStreamOption = pipeline.add_option("--input-regions", inputRegionsStream, "Input region of each split, as JSON");
+
+  std::vector<itk::IndexValueType> inputIndex;
+  pipeline.add_option("--input-index", inputIndex, "Index of the first input voxel, when the input is a crop")->expected(2, 3)->delimiter(',');
+
   ITK_WASM_PARSE(pipeline);
 
-  auto inImage = inputImage.Get();
+  if (inputRegionsStreamOption->empty() && outputImageOption->empty())
+  {
+    std::cerr << "Error: OutputImage is required" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  typename ImageType::ConstPointer inImage = inputImage.Get();
+  if (!inputIndex.empty())
+  {
+    // same pixels and geometry, with the crop's place in the full input
+    auto cropped = ImageType::New();
+    cropped->Graft(inImage);
+    typename ImageType::RegionType croppedRegion(inImage->GetLargestPossibleRegion().GetSize());
+    for (unsigned int d = 0; d < ImageType::ImageDimension; ++d)
+    {
+      croppedRegion.SetIndex(d, inputIndex[d]);
+    }
+    cropped->SetRegions(croppedRegion);
+    inImage = cropped;
+  }
 
   using ResampleFilterType = itk::ResampleImageFilter<ImageType, ImageType>;
   auto resampleFilter = ResampleFilterType::New();
@@ -129,8 +168,87 @@ int Resample(itk::wasm::Pipeline &pipeline, itk::wasm::InputImage<TImage> &input
     numberOfSplitsStream.Get() << numberOfSplits;
   }
 
+  // blur over about one input voxel, so labels keep their boundaries
+  using LabelInterpolatorType = itk::LabelImageGaussianInterpolateImageFunction<ImageType, double>;
+  typename LabelInterpolatorType::Pointer labelInterpolator;
+  if (interpolator == "label-gaussian")
+  {
+    labelInterpolator = LabelInterpolatorType::New();
+    typename LabelInterpolatorType::ArrayType sigma;
+    for (int i = 0; i < dims; ++i)
+    {
+      sigma[i] = inImage->GetSpacing()[i];
+    }
+    labelInterpolator->SetSigma(sigma);
+  }
+
+  if (!inputRegionsStreamOption->empty())
+  {
+    // voxels past the bounding box each interpolator can read
+    itk::IndexValueType padding = 1;
+    if (labelInterpolator)
+    {
+      // the kernel is cut off alpha sigmas away from the point
+      for (unsigned int d = 0; d < ImageType::ImageDimension; ++d)
+      {
+        const double cutOff =
+          labelInterpolator->GetAlpha() * labelInterpolator->GetSigma()[d] / inImage->GetSpacing()[d];
+        padding = std::max(padding, static_cast<itk::IndexValueType>(std::ceil(cutOff)) + 1);
+      }
+    }
+    auto & stream = inputRegionsStream.Get();
+    stream << "[";
+    for (unsigned int i = 0; i < numberOfSplits; ++i)
+    {
+      RegionType splitRegion(largestRegion);
+      splitter->GetSplit(i, numberOfSplits, splitRegion);
+      // B-spline coefficients depend on the whole input, so it is not cropped
+      const RegionType inputRegion =
+        interpolator == "bspline"
+          ? inImage->GetLargestPossibleRegion()
+          : InputRegionForOutputRegion<ImageType>(inImage, splitRegion, outputSpacing, outputOrigin, outputDirection, padding);
+      stream << (i ? "," : "") << "{\"index\":[";
+      for (unsigned int d = 0; d < ImageType::ImageDimension; ++d)
+      {
+        stream << (d ? "," : "") << inputRegion.GetIndex(d);
+      }
+      stream << "],\"size\":[";
+      for (unsigned int d = 0; d < ImageType::ImageDimension; ++d)
+      {
+        stream << (d ? "," : "") << inputRegion.GetSize(d);
+      }
+      stream << "]}";
+    }
+    stream << "]";
+    return EXIT_SUCCESS;
+  }
+
   RegionType requestedRegion(largestRegion);
   splitter->GetSplit(split, numberOfSplits, requestedRegion);
+
+  // Overlays usually share the direction of the image they are resampled to,
+  // and only differ in spacing and origin.
+  const bool nearest = interpolator == "nearest";
+  if (CanResampleAxisAligned<ImageType>(inImage, outputDirection, interpolator, resampleFilter->GetTransform()))
+  {
+    outputImage.Set(ResampleAxisAligned<ImageType>(
+      inImage, requestedRegion, outputSpacing, outputOrigin, outputDirection, nearest));
+    return EXIT_SUCCESS;
+  }
+
+  if (nearest)
+  {
+    resampleFilter->SetInterpolator(itk::NearestNeighborInterpolateImageFunction<ImageType, double>::New());
+  }
+  else if (labelInterpolator)
+  {
+    resampleFilter->SetInterpolator(labelInterpolator);
+  }
+  else if (interpolator == "bspline")
+  {
+    resampleFilter->SetInterpolator(itk::BSplineInterpolateImageFunction<ImageType, double, double>::New());
+  }
+
   auto roiFilter = ROIFilterType::New();
   roiFilter->SetExtractionRegion(requestedRegion);
   roiFilter->SetInput(resampleFilter->GetOutput());
@@ -12,7 +12,21 @@ export function compareImageSpaces(imageA: Image, imageB: Image) {
   return equalKeys.every((b) => b);
 }
 
-export async function resample(fixed: Image, moving: Image) {
+/**
+ * How moving image values are sampled onto the fixed image grid. Labelmaps
+ * should use 'nearest' or 'label-gaussian' so no new label values are made up.
+ */
+export type Interpolator = 'nearest' | 'linear' | 'label-gaussian' | 'bspline';
+
+export type ResampleOptions = {
+  interpolator?: Interpolator;
+};
+
+export async function resample(
+  fixed: Image,
+  moving: Image,
+  { interpolator = 'linear' }: ResampleOptions = {}
+) {
   if (compareImageSpaces(fixed, moving)) return moving; // same space, just return
 
   const { size, spacing, origin, direction } = fixed;
@@ -25,7 +39,9 @@ export async function resample(fixed: Image, moving: Image) {
     origin.join(','),
     '--direction',
     direction.join(','),
+    '--interpolator',
+    interpolator,
   ];
 
-  return runWasm('resample', args, [moving]);
+  return runWasm('resample', args, [moving], undefined, { cropInputs: true });
 }
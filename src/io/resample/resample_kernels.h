@@ -0,0 +1,309 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#pragma once
+
+#include "itkContinuousIndex.h"
+#include "itkIdentityTransform.h"
+#include "itkImage.h"
+#include "itkNumericTraits.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <string>
+#include <vector>
+
+// Directions closer than this, element by element, are treated as equal, as
+// with ITK's default direction tolerance.
+constexpr double DirectionTolerance = 1e-6;
+
+template <typename TDirection>
+bool
+DirectionsMatch(const TDirection & a, const TDirection & b)
+{
+  for (unsigned int row = 0; row < TDirection::RowDimensions; ++row)
+  {
+    for (unsigned int col = 0; col < TDirection::ColumnDimensions; ++col)
+    {
+      if (std::abs(a(row, col) - b(row, col)) > DirectionTolerance)
+      {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Interpolation taps along one axis, for each output index: the input offsets
+// to blend, the weight of the upper one, and whether the point is inside the
+// input at all. Nearest neighbor taps only use the lower offset.
+struct AxisTaps
+{
+  std::vector<itk::OffsetValueType> lower;
+  std::vector<itk::OffsetValueType> upper;
+  std::vector<double>               weight;
+  std::vector<char>                 inside;
+};
+
+// Mirrors itk::LinearInterpolateImageFunction, or
+// itk::NearestNeighborInterpolateImageFunction, and the IsInsideBuffer test of
+// itk::ResampleImageFilter, along one axis.
+inline AxisTaps
+ComputeAxisTaps(double               firstIndex,
+                double               step,
+                itk::SizeValueType   count,
+                itk::IndexValueType  start,
+                itk::SizeValueType   size,
+                itk::OffsetValueType stride,
+                bool                 nearest)
+{
+  AxisTaps taps;
+  taps.lower.resize(count);
+  taps.upper.resize(count);
+  taps.weight.resize(count);
+  taps.inside.resize(count);
+
+  const itk::IndexValueType end = start + static_cast<itk::IndexValueType>(size) - 1;
+  for (itk::SizeValueType i = 0; i < count; ++i)
+  {
+    const double index = firstIndex + i * step;
+    taps.inside[i] = index >= start - 0.5 && index < end + 0.5;
+
+    // rounding half up, as ConvertContinuousIndexToNearestIndex does
+    itk::IndexValueType base = static_cast<itk::IndexValueType>(std::floor(nearest ? index + 0.5 : index));
+    base = std::min(std::max(base, start), end);
+    const double distance = index - base;
+    const bool   blend = !nearest && distance > 0. && base < end;
+    taps.lower[i] = (base - start) * stride;
+    taps.upper[i] = blend ? taps.lower[i] + stride : taps.lower[i];
+    taps.weight[i] = blend ? distance : 0.;
+  }
+  return taps;
+}
+
+/**
+ * Linear or nearest neighbor resampling onto a grid with the input's
+ * direction.
+ *
+ * The input index along each axis then only depends on the output index along
+ * that axis, so the taps and weights are computed once per axis, and each
+ * output row reads a few input rows in order, instead of transforming every
+ * voxel through physical space. Nearest neighbor rows copy the input pixels
+ * as they are, with no conversion to real values, which keeps label IDs
+ * exact.
+ */
+template <typename TImage>
+typename TImage::Pointer
+ResampleAxisAligned(const TImage *                          input,
+                    const typename TImage::RegionType &     outputRegion,
+                    const typename TImage::SpacingType &    outputSpacing,
+                    const typename TImage::PointType &      outputOrigin,
+                    const typename TImage::DirectionType &  outputDirection,
+                    bool                                    nearest)
+{
+  using PixelType = typename TImage::PixelType;
+  constexpr unsigned int Dimension = TImage::ImageDimension;
+
+  auto output = TImage::New();
+  output->SetRegions(outputRegion);
+  output->SetSpacing(outputSpacing);
+  output->SetOrigin(outputOrigin);
+  output->SetDirection(outputDirection);
+  output->Allocate();
+
+  // continuous input index of the first output voxel
+  typename TImage::PointType firstPoint;
+  output->TransformIndexToPhysicalPoint(outputRegion.GetIndex(), firstPoint);
+  itk::ContinuousIndex<double, Dimension> firstIndex;
+  input->TransformPhysicalPointToContinuousIndex(firstPoint, firstIndex);
+
+  const auto & inputRegion = input->GetBufferedRegion();
+  const auto & outputSize = outputRegion.GetSize();
+
+  // 2D images get a third axis of one voxel
+  AxisTaps                  taps[3];
+  itk::OffsetValueType      stride = 1;
+  for (unsigned int d = 0; d < 3; ++d)
+  {
+    if (d < Dimension)
+    {
+      taps[d] = ComputeAxisTaps(firstIndex[d],
+                                outputSpacing[d] / input->GetSpacing()[d],
+                                outputSize[d],
+                                inputRegion.GetIndex(d),
+                                inputRegion.GetSize(d),
+                                stride,
+                                nearest);
+      stride *= inputRegion.GetSize(d);
+    }
+    else
+    {
+      taps[d] = ComputeAxisTaps(0., 0., 1, 0, 1, 0, nearest);
+    }
+  }
+
+  using RealType = double;
+  const RealType minimum = itk::NumericTraits<PixelType>::NonpositiveMin();
+  const RealType maximum = itk::NumericTraits<PixelType>::max();
+  auto lerp = [](RealType a, RealType b, RealType weight) { return a + (b - a) * weight; };
+
+  const PixelType * in = input->GetBufferPointer();
+  PixelType *       out = output->GetBufferPointer();
+  const auto &      xTaps = taps[0];
+  const auto &      yTaps = taps[1];
+  const auto &      zTaps = taps[2];
+  const itk::SizeValueType width = outputSize[0];
+  for (itk::SizeValueType z = 0; z < zTaps.inside.size(); ++z)
+  {
+    for (itk::SizeValueType y = 0; y < yTaps.inside.size(); ++y, out += width)
+    {
+      if (!zTaps.inside[z] || !yTaps.inside[y])
+      {
+        std::fill(out, out + width, PixelType{});
+        continue;
+      }
+      if (nearest)
+      {
+        const PixelType * row = in + zTaps.lower[z] + yTaps.lower[y];
+        for (itk::SizeValueType x = 0; x < width; ++x)
+        {
+          out[x] = xTaps.inside[x] ? row[xTaps.lower[x]] : PixelType{};
+        }
+        continue;
+      }
+      const PixelType * row00 = in + zTaps.lower[z] + yTaps.lower[y];
+      const PixelType * row01 = in + zTaps.lower[z] + yTaps.upper[y];
+      const PixelType * row10 = in + zTaps.upper[z] + yTaps.lower[y];
+      const PixelType * row11 = in + zTaps.upper[z] + yTaps.upper[y];
+      const RealType    wy = yTaps.weight[y];
+      const RealType    wz = zTaps.weight[z];
+      for (itk::SizeValueType x = 0; x < width; ++x)
+      {
+        if (!xTaps.inside[x])
+        {
+          out[x] = PixelType{};
+          continue;
+        }
+        const auto     lower = xTaps.lower[x];
+        const auto     upper = xTaps.upper[x];
+        const RealType wx = xTaps.weight[x];
+        // x, then y, then z, as LinearInterpolateImageFunction blends them
+        const RealType v00 = lerp(row00[lower], row00[upper], wx);
+        const RealType v01 = lerp(row01[lower], row01[upper], wx);
+        const RealType v10 = lerp(row10[lower], row10[upper], wx);
+        const RealType v11 = lerp(row11[lower], row11[upper], wx);
+        const RealType value = lerp(lerp(v00, v01, wy), lerp(v10, v11, wy), wz);
+        // ResampleImageFilter's bounds-checked cast
+        out[x] = value < minimum   ? static_cast<PixelType>(minimum)
+                 : value > maximum ? static_cast<PixelType>(maximum)
+                                   : static_cast<PixelType>(value);
+      }
+    }
+  }
+
+  return output;
+}
+
+/**
+ * Whether ResampleAxisAligned computes what itk::ResampleImageFilter would
+ * with this interpolator and transform: nearest neighbor or linear
+ * interpolation, the filter's default identity transform, and an output grid
+ * with the input's direction. Anything else goes through the filter.
+ */
+template <typename TImage, typename TTransform>
+bool
+CanResampleAxisAligned(const TImage *                         input,
+                       const typename TImage::DirectionType & outputDirection,
+                       const std::string &                    interpolator,
+                       const TTransform *                     transform)
+{
+  using IdentityTransformType = itk::IdentityTransform<typename TTransform::ScalarType, TImage::ImageDimension>;
+  return (interpolator == "nearest" || interpolator == "linear") &&
+         dynamic_cast<const IdentityTransformType *>(transform) != nullptr &&
+         DirectionsMatch(input->GetDirection(), outputDirection);
+}
+
+/**
+ * The input region a split of the output reads from: the bounding box of the
+ * input indices its corners map to, widened by padding voxels for the
+ * interpolator's support and cropped to the input.
+ *
+ * Output indices map to input indices through an affine transform, so every
+ * output voxel of the region maps inside the box of its corners. A region
+ * that misses the input entirely becomes one voxel in its corner, as the
+ * whole split is then outside the input.
+ */
+template <typename TImage>
+typename TImage::RegionType
+InputRegionForOutputRegion(const TImage *                          input,
+                           const typename TImage::RegionType &     outputRegion,
+                           const typename TImage::SpacingType &    outputSpacing,
+                           const typename TImage::PointType &      outputOrigin,
+                           const typename TImage::DirectionType &  outputDirection,
+                           itk::IndexValueType                     padding)
+{
+  constexpr unsigned int Dimension = TImage::ImageDimension;
+
+  // output geometry only, nothing is allocated
+  auto grid = TImage::New();
+  grid->SetSpacing(outputSpacing);
+  grid->SetOrigin(outputOrigin);
+  grid->SetDirection(outputDirection);
+
+  double lower[Dimension];
+  double upper[Dimension];
+  std::fill(lower, lower + Dimension, std::numeric_limits<double>::max());
+  std::fill(upper, upper + Dimension, std::numeric_limits<double>::lowest());
+  for (unsigned int corner = 0; corner < (1u << Dimension); ++corner)
+  {
+    typename TImage::IndexType index;
+    for (unsigned int d = 0; d < Dimension; ++d)
+    {
+      index[d] = outputRegion.GetIndex(d);
+      if (corner & (1u << d))
+      {
+        index[d] += static_cast<itk::IndexValueType>(outputRegion.GetSize(d)) - 1;
+      }
+    }
+    typename TImage::PointType point;
+    grid->TransformIndexToPhysicalPoint(index, point);
+    itk::ContinuousIndex<double, Dimension> inputIndex;
+    input->TransformPhysicalPointToContinuousIndex(point, inputIndex);
+    for (unsigned int d = 0; d < Dimension; ++d)
+    {
+      lower[d] = std::min(lower[d], inputIndex[d]);
+      upper[d] = std::max(upper[d], inputIndex[d]);
+    }
+  }
+
+  typename TImage::RegionType region;
+  for (unsigned int d = 0; d < Dimension; ++d)
+  {
+    const auto start = static_cast<itk::IndexValueType>(std::floor(lower[d])) - padding;
+    const auto end = static_cast<itk::IndexValueType>(std::ceil(upper[d])) + padding;
+    region.SetIndex(d, start);
+    region.SetSize(d, static_cast<itk::SizeValueType>(end - start + 1));
+  }
+
+  const auto & largestRegion = input->GetLargestPossibleRegion();
+  if (!region.Crop(largestRegion))
+  {
+    region.SetIndex(largestRegion.GetIndex());
+    region.SetSize(TImage::SizeType::Filled(1));
+  }
+  return region;
+}
@@ -0,0 +1,94 @@
+import { describe, it, beforeEach, vi } from 'vitest';
+import { expect } from 'chai';
+
+import { createTestingPinia } from '@pinia/testing';
+import { Image, ImageType, IntTypes, PixelTypes } from 'itk-wasm';
+import { CorePiniaProviderPlugin } from '@/src/core/provider';
+import ProxyWrapper from '@/src/core/proxies';
+import { DICOMIO } from '@/src/io/dicom';
+import { useDICOMStore } from '@/src/store/datasets-dicom';
+import { useImageStore } from '@/src/store/datasets-images';
+
+function createImage() {
+  const image = new Image(
+    new ImageType(3, IntTypes.Int16, PixelTypes.Scalar, 1)
+  );
+  image.size = [2, 2, 2];
+  image.data = new Int16Array(8);
+  return image;
+}
+
+const volumeKey = 'volume';
+
+describe('DICOM store', () => {
+  let dicomIO: { buildImageProgressive: ReturnType<typeof vi.fn> };
+
+  beforeEach(() => {
+    dicomIO = { buildImageProgressive: vi.fn() };
+    const proxies = { addData: vi.fn(), updateData: vi.fn() };
+    createTestingPinia({
+      createSpy: vi.fn,
+      stubActions: false,
+      plugins: [
+        CorePiniaProviderPlugin({
+          dicomIO: dicomIO as unknown as DICOMIO,
+          proxies: proxies as unknown as ProxyWrapper,
+        }),
+      ],
+    });
+
+    const store = useDICOMStore();
+    store.volumeInfo[volumeKey] = {
+      NumberOfFrame: '',
+      NumberOfSlices: 2,
+      VolumeID: volumeKey,
+      Modality: 'CT',
+      SeriesInstanceUID: '1.2.3',
+      SeriesNumber: '1',
+      SeriesDescription: '',
+    };
+  });
+
+  it('should show the volume once built', async () => {
+    dicomIO.buildImageProgressive.mockImplementation(
+      async (files: File[], onPreview: (image: Image) => void) => {
+        onPreview(createImage());
+        return createImage();
+      }
+    );
+
+    const store = useDICOMStore();
+    const imageStore = useImageStore();
+    await store.buildVolume(volumeKey);
+
+    const imageID = store.volumeToImageID[volumeKey]!;
+    expect(imageStore.idList).to.deep.equal([imageID]);
+    expect(store.imageIDToVolumeKey[imageID]).to.equal(volumeKey);
+  });
+
+  it('should remove the preview of a failed build', async () => {
+    dicomIO.buildImageProgressive.mockImplementation(
+      async (files: File[], onPreview: (image: Image) => void) => {
+        onPreview(createImage());
+        throw new Error('build failed');
+      }
+    );
+
+    const store = useDICOMStore();
+    const imageStore = useImageStore();
+    let error: Error | undefined;
+    await store.buildVolume(volumeKey).catch((err) => {
+      error = err;
+    });
+
+    expect(error?.message).to.equal('build failed');
+    expect(store.volumeToImageID).to.not.have.key(volumeKey);
+    expect(store.imageIDToVolumeKey).to.deep.equal({});
+    expect(imageStore.idList).to.deep.equal([]);
+
+    // a retry builds the volume again
+    dicomIO.buildImageProgressive.mockResolvedValue(createImage());
+    await store.buildVolume(volumeKey);
+    expect(imageStore.idList).to.have.length(1);
+  });
+});
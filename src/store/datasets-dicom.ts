@@ -1,23 +1,34 @@
 import vtkITKHelper from '@kitware/vtk.js/Common/DataModel/ITKHelper';
+import { vtkImageData } from '@kitware/vtk.js/Common/DataModel/ImageData';
 import { defineStore } from 'pinia';
 import { Image } from 'itk-wasm';
 import { DataSourceWithFile } from '@/src/io/import/dataSource';
 import { pick, removeFromArray } from '../utils';
 import { useImageStore } from './datasets-images';
 import { useFileStore } from './datasets-files';
+import { useMessageStore } from './messages';
 import { StateFile, DatasetType } from '../io/state-file/schema';
 import { serializeData } from '../io/state-file/utils';
-import { DICOMIO } from '../io/dicom';
+import { DICOMIO, VolumeGeometry } from '../io/dicom';
 // import { object } from 'zod';
 // import { file } from 'jszip';
 
 export const ANONYMOUS_PATIENT = 'Anonymous';
 export const ANONYMOUS_PATIENT_ID = 'ANONYMOUS';
 
-export function imageCacheMultiKey(offset: number, asThumbnail: boolean) {
-  return `${offset}!!${asThumbnail}`;
+// Longest edge of volume thumbnails, matching the volume browser tiles
+export const THUMBNAIL_SIZE = 150;
+
+// Frame shown in the thumbnail of a volume, -1 if it is not a multi-frame
+// file
+function thumbnailFrame(volumeInfo: VolumeInfo) {
+  const frames = parseInt(volumeInfo.NumberOfFrame, 10);
+  return frames > 1 ? Math.floor(frames / 2) : -1;
 }
 
+// volumeKey -> volume being built
+const pendingBuilds = new Map<string, Promise<vtkImageData>>();
+
 export interface VolumeKeys {
   patientKey: string;
   studyKey: string;
@@ -51,8 +62,8 @@ export interface VolumeInfo {
 }
 
 interface State {
-  // volumeKey -> imageCacheMultiKey -> ITKImage
-  sliceData: Record<string, Record<string, Image>>;
+  // volumeKey -> PNG thumbnail
+  volumeThumbnails: Record<string, Blob>;
 
   // volumeKey -> imageID
   volumeToImageID: Record<string, string | undefined>;
@@ -75,6 +86,9 @@ interface State {
   // volumeKey -> volume info
   volumeInfo: Record<string, VolumeInfo>;
 
+  // volumeKey -> slice layout found when categorizing
+  volumeGeometry: Record<string, VolumeGeometry>;
+
   // parent pointers
   // volumeKey -> studyKey
   volumeStudy: Record<string, string>;
@@ -82,8 +96,8 @@ interface State {
   studyPatient: Record<string, string>;
 }
 
-const readDicomTags = (dicomIO: DICOMIO, file: File) =>
-  dicomIO.readTags(file, [
+const readDicomTags = (dicomIO: DICOMIO, files: File[]) =>
+  dicomIO.readTagsOfFiles(files, [
     { name: 'PatientName', tag: '0010|0010', strconv: true },
     { name: 'PatientID', tag: '0010|0020', strconv: true },
     { name: 'PatientBirthDate', tag: '0010|0030' },
@@ -103,7 +117,7 @@ const readDicomTags = (dicomIO: DICOMIO, file: File) =>
 
 export const useDICOMStore = defineStore('dicom', {
   state: (): State => ({
-    sliceData: {},
+    volumeThumbnails: {},
     volumeToImageID: {},
     imageIDToVolumeKey: {},
     patientInfo: {},
@@ -111,6 +125,7 @@ export const useDICOMStore = defineStore('dicom', {
     studyInfo: {},
     studyVolumes: {},
     volumeInfo: {},
+    volumeGeometry: {},
     volumeStudy: {},
     studyPatient: {},
     needsRebuild: {},
@@ -126,7 +141,9 @@ export const useDICOMStore = defineStore('dicom', {
       );
       const allFiles = [...fileToDataSource.keys()];
 
-      const volumeToFiles = await dicomIO.categorizeFiles(allFiles);
+      const { volumes: volumeToFiles, geometry } =
+        await dicomIO.categorizeFiles(allFiles);
+      Object.assign(this.volumeGeometry, geometry);
 
       const fileStore = useFileStore();
 
@@ -141,56 +158,84 @@ export const useDICOMStore = defineStore('dicom', {
         fileStore.add(volumeKey, volumeDatasetFiles);
       });
 
-      await Promise.all(
-        Object.entries(volumeToFiles).map(async ([volumeKey, files]) => {
-          // Read tags of first file
-          if (!(volumeKey in this.volumeInfo)) {
-            const tags = await readDicomTags(dicomIO, files[0]);
-
-            // if (tags.NumberOfFrame == "41") {
-            //   console.log(`FFFFNNNNAAAMMMMEEE:${files[0].name}`);
-            // }
-            // TODO parse the raw string values
-            const patient = {
-              PatientID: tags.PatientID || ANONYMOUS_PATIENT_ID,
-              PatientName: tags.PatientName || ANONYMOUS_PATIENT,
-              PatientBirthDate: tags.PatientBirthDate || '',
-              PatientSex: tags.PatientSex || '',
-            };
-
-            const study = pick(
-              tags,
-              'StudyID',
-              'StudyInstanceUID',
-              'StudyDate',
-              'StudyTime',
-              'AccessionNumber',
-              'StudyDescription'
-            );
-
-            const volumeInfo = {
-              ...pick(
-                tags,
-                'Modality',
-                'SeriesInstanceUID',
-                'SeriesNumber',
-                'SeriesDescription',
-                'NumberOfFrame'
-              ),
-              NumberOfSlices: files.length,
-              VolumeID: volumeKey,
-            };
-
-            this._updateDatabase(patient, study, volumeInfo);
-          }
+      // Read tags of the first file of each new volume, all in one go
+      const newVolumeKeys = Object.keys(volumeToFiles).filter(
+        (volumeKey) => !(volumeKey in this.volumeInfo)
+      );
+      const newVolumeTags = await readDicomTags(
+        dicomIO,
+        newVolumeKeys.map((volumeKey) => volumeToFiles[volumeKey][0])
+      );
 
-          // invalidate any existing volume
-          if (volumeKey in this.volumeToImageID) {
-            // buildVolume requestor uses this as a rebuild hint
-            this.needsRebuild[volumeKey] = true;
-          }
-        })
+      newVolumeKeys.forEach((volumeKey, v) => {
+        const tags = newVolumeTags[v];
+
+        // TODO parse the raw string values
+        const patient = {
+          PatientID: tags.PatientID || ANONYMOUS_PATIENT_ID,
+          PatientName: tags.PatientName || ANONYMOUS_PATIENT,
+          PatientBirthDate: tags.PatientBirthDate || '',
+          PatientSex: tags.PatientSex || '',
+        };
+
+        const study = pick(
+          tags,
+          'StudyID',
+          'StudyInstanceUID',
+          'StudyDate',
+          'StudyTime',
+          'AccessionNumber',
+          'StudyDescription'
+        );
+
+        const volumeInfo = {
+          ...pick(
+            tags,
+            'Modality',
+            'SeriesInstanceUID',
+            'SeriesNumber',
+            'SeriesDescription',
+            'NumberOfFrame'
+          ),
+          NumberOfSlices: volumeToFiles[volumeKey].length,
+          VolumeID: volumeKey,
+        };
+
+        this._updateDatabase(patient, study, volumeInfo);
+      });
+
+      const irregularVolumes = Object.keys(volumeToFiles).filter(
+        (volumeKey) => {
+          const diagnostics = geometry[volumeKey]?.diagnostics;
+          return (
+            diagnostics &&
+            (diagnostics.duplicatePositions > 0 ||
+              diagnostics.missingSlices > 0 ||
+              diagnostics.irregularSpacing)
+          );
+        }
       );
+      if (irregularVolumes.length) {
+        const seriesNames = irregularVolumes.map((volumeKey) => {
+          const info = this.volumeInfo[volumeKey];
+          return (
+            info?.SeriesDescription ||
+            (info?.SeriesNumber ? `Series ${info.SeriesNumber}` : 'Unnamed series')
+          );
+        });
+        useMessageStore().addWarning(
+          'Some DICOM volumes have missing, duplicate or unevenly spaced slices',
+          `They may look distorted once built: ${seriesNames.join(', ')}`
+        );
+      }
+
+      Object.keys(volumeToFiles).forEach((volumeKey) => {
+        // invalidate any existing volume
+        if (volumeKey in this.volumeToImageID) {
+          // buildVolume requestor uses this as a rebuild hint
+          this.needsRebuild[volumeKey] = true;
+        }
+      });
       // const promises = Object.entries(volumeToFiles).map(async ([volumeKey, files]) => {
       //   // Read tags of first file
       //   if (!(volumeKey in this.volumeInfo)) {
@@ -267,7 +312,6 @@ export const useDICOMStore = defineStore('dicom', {
       if (!(volumeKey in this.volumeInfo)) {
         this.volumeInfo[volumeKey] = volume;
         this.volumeStudy[volumeKey] = studyKey;
-        this.sliceData[volumeKey] = {};
         this.studyVolumes[studyKey].push(volumeKey);
       }
     },
@@ -277,7 +321,8 @@ export const useDICOMStore = defineStore('dicom', {
       if (volumeKey in this.volumeInfo) {
         const studyKey = this.volumeStudy[volumeKey];
         delete this.volumeInfo[volumeKey];
-        delete this.sliceData[volumeKey];
+        delete this.volumeGeometry[volumeKey];
+        delete this.volumeThumbnails[volumeKey];
         delete this.volumeStudy[volumeKey];
 
         if (volumeKey in this.volumeToImageID) {
@@ -339,64 +384,69 @@ export const useDICOMStore = defineStore('dicom', {
       });
     },
 
-    // returns an ITK image object
-    async getVolumeSlice(
-      volumeKey: string,
-      sliceIndex: number,
-      asThumbnail = false
-    ) {
+    // returns volumeKey -> PNG thumbnail, null if it could not be read.
+    // Thumbnails that are not cached are read in one batched call.
+    async getVolumeThumbnails(volumeKeys: string[]) {
       const dicomIO = this.$dicomIO;
       const fileStore = useFileStore();
 
-      const cacheKey = imageCacheMultiKey(sliceIndex, asThumbnail);
-      if (
-        volumeKey in this.sliceData &&
-        cacheKey in this.sliceData[volumeKey]
-      ) {
-        return this.sliceData[volumeKey][cacheKey];
-      }
-
-      if (!(volumeKey in this.volumeInfo)) {
-        throw new Error(`Cannot find given volume key: ${volumeKey}`);
-      }
-      const volumeInfo = this.volumeInfo[volumeKey];
-      const numSlices = volumeInfo.NumberOfSlices;
-
-      if (sliceIndex < 1 || sliceIndex > numSlices) {
-        throw new Error(`Slice ${sliceIndex} is out of bounds`);
-      }
+      const thumbnails: Record<string, Blob | null> = {};
+      const toRead: Array<{
+        volumeKey: string;
+        file: File;
+        frame: number;
+      }> = [];
+      volumeKeys.forEach((volumeKey) => {
+        if (!(volumeKey in this.volumeInfo)) {
+          throw new Error(`Cannot find given volume key: ${volumeKey}`);
+        }
+        if (volumeKey in this.volumeThumbnails) {
+          thumbnails[volumeKey] = this.volumeThumbnails[volumeKey];
+          return;
+        }
 
-      const volumeFiles = fileStore.getFiles(volumeKey);
+        const { NumberOfSlices } = this.volumeInfo[volumeKey];
+        const middleSlice = Math.ceil(NumberOfSlices / 2);
+        const volumeFiles = fileStore.getFiles(volumeKey);
+        if (!volumeFiles) {
+          throw new Error(`No files found for volume key: ${volumeKey}`);
+        }
+        toRead.push({
+          volumeKey,
+          file: volumeFiles[middleSlice - 1],
+          frame: thumbnailFrame(this.volumeInfo[volumeKey]),
+        });
+      });
 
-      if (!volumeFiles) {
-        throw new Error(`No files found for volume key: ${volumeKey}`);
+      if (toRead.length) {
+        const encoded = await dicomIO.getEncodedThumbnails(
+          toRead.map(({ file }) => file),
+          THUMBNAIL_SIZE,
+          toRead.map(({ frame }) => frame)
+        );
+        toRead.forEach(({ volumeKey }, index) => {
+          const thumbnail = encoded[index];
+          // the volume may have been deleted in the meantime
+          if (thumbnail && volumeKey in this.volumeInfo) {
+            this.volumeThumbnails[volumeKey] = thumbnail;
+          }
+          thumbnails[volumeKey] = thumbnail;
+        });
       }
 
-      const sliceFile = volumeFiles[sliceIndex - 1];
-
-      const itkImage = await dicomIO.getVolumeSlice(sliceFile, asThumbnail);
-
-      this.sliceData[volumeKey][cacheKey] = itkImage;
-      return itkImage;
-    },
-
-    // returns an ITK image object
-    async getVolumeThumbnail(volumeKey: string) {
-      const { NumberOfSlices } = this.volumeInfo[volumeKey];
-      // const { NumberOfSlices, NumberOfFrame } = this.volumeInfo[volumeKey];
-      // if (NumberOfFrame.length > 0) {
-      //   NumberOfSlices = parseInt(NumberOfFrame);
-      // }
-      const middleSlice = Math.ceil(NumberOfSlices / 2);
-      // console.log(`volumeKey:${volumeKey}`)
-      // console.log(`NumberOfSlices:${NumberOfSlices},NumberOfFrame:${NumberOfFrame}`)
-      return this.getVolumeSlice(volumeKey, middleSlice, true);
+      return thumbnails;
     },
 
     async buildVolume(volumeKey: string, forceRebuild: boolean = false) {
       const imageStore = useImageStore();
       const dicomIO = this.$dicomIO;
 
+      // a preview may already be shown while the full volume is built
+      const pending = pendingBuilds.get(volumeKey);
+      if (pending) {
+        return pending;
+      }
+
       const rebuild = forceRebuild || this.needsRebuild[volumeKey];
 
       if (!rebuild && this.volumeToImageID[volumeKey]) {
@@ -407,23 +457,52 @@ export const useDICOMStore = defineStore('dicom', {
       const fileStore = useFileStore();
       const files = fileStore.getFiles(volumeKey);
       if (!files) throw new Error('No files for volume key');
-      const image = vtkITKHelper.convertItkToVtkImage(
-        await dicomIO.buildImage(files)
-      );
 
-      const existingImageID = this.volumeToImageID[volumeKey];
-      if (existingImageID) {
-        imageStore.updateData(existingImageID, image);
-      } else {
-        const name = this.volumeInfo[volumeKey].SeriesInstanceUID;
-        const imageID = imageStore.addVTKImageData(name, image);
-        this.imageIDToVolumeKey[imageID] = volumeKey;
-        this.volumeToImageID[volumeKey] = imageID;
-      }
-
-      delete this.needsRebuild[volumeKey];
+      const setImage = (itkImage: Image) => {
+        const image = vtkITKHelper.convertItkToVtkImage(itkImage);
+        const existingImageID = this.volumeToImageID[volumeKey];
+        if (existingImageID) {
+          imageStore.updateData(existingImageID, image);
+        } else {
+          const name = this.volumeInfo[volumeKey].SeriesInstanceUID;
+          const imageID = imageStore.addVTKImageData(name, image);
+          this.imageIDToVolumeKey[imageID] = volumeKey;
+          this.volumeToImageID[volumeKey] = imageID;
+        }
+        return image;
+      };
+
+      // Previews would replace the volume being rebuilt, so only show them
+      // for new volumes.
+      const showPreviews = !this.volumeToImageID[volumeKey];
+      const build = dicomIO
+        .buildImageProgressive(files, (preview) => {
+          // the volume may have been deleted in the meantime
+          if (showPreviews && volumeKey in this.volumeInfo) {
+            setImage(preview);
+          }
+        })
+        .then((itkImage) => {
+          const image = setImage(itkImage);
+          delete this.needsRebuild[volumeKey];
+          return image;
+        })
+        .catch((err) => {
+          // a preview is not the volume, so drop it rather than leave it shown
+          const previewID = this.volumeToImageID[volumeKey];
+          if (showPreviews && previewID) {
+            imageStore.deleteData(previewID);
+            delete this.volumeToImageID[volumeKey];
+            delete this.imageIDToVolumeKey[previewID];
+          }
+          throw err;
+        })
+        .finally(() => {
+          pendingBuilds.delete(volumeKey);
+        });
+      pendingBuilds.set(volumeKey, build);
 
-      return image;
+      return build;
     },
   },
 });
@@ -87,9 +87,14 @@ export const useLayersStore = defineStore('layer', () => {
       );
     }
 
+    // segmentation volumes hold label IDs, which must not be blended
+    const isLabelmap =
+      source.type === 'dicom' &&
+      useDICOMStore().volumeInfo[source.volumeKey]?.Modality === 'SEG';
     const itkImage = await resample(
       vtkITKHelper.convertVtkToItkImage(parentImage),
-      vtkITKHelper.convertVtkToItkImage(sourceImage)
+      vtkITKHelper.convertVtkToItkImage(sourceImage),
+      { interpolator: isLabelmap ? 'nearest' : 'linear' }
     );
     const image = vtkITKHelper.convertItkToVtkImage(itkImage);
 